@@ -0,0 +1,65 @@
+/*
+ * bench_small_kernels.c times the kernels calc_small_quadratic_form
+ * specializes for 3 <= m <= SMALL_KERNEL_MAX against the generic path they
+ * replace in calculate_rss, calc_cholesky_decomposition followed by
+ * calc_quadratic_form, on the same random correlation matrices.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <scores/linearalgebra.h>
+
+#include "kernel_inputs.h"
+
+#define NOBS     200
+#define MATRICES 64
+#define REPEATS  20000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+int main(void)
+{
+    int     size   = SMALL_KERNEL_MAX * (SMALL_KERNEL_MAX + 1);
+    double *inputs = malloc(MATRICES * size * sizeof(double));
+    double  buf[SMALL_KERNEL_MAX * (SMALL_KERNEL_MAX + 2)];
+    printf(" m  generic (ns)  kernel (ns)  speedup\n");
+    for (int m = 3; m <= SMALL_KERNEL_MAX; ++m) {
+        for (int k = 0; k < MATRICES; ++k)
+            kernel_inputs(inputs + k * size, inputs + k * size + m * m, m,
+                              NOBS, 0.0);
+        /* the generic path factors copies, as calculate_rss does */
+        volatile double sink = 0.0;
+        double start = now();
+        for (int r = 0; r < REPEATS; ++r) {
+            double *cov = inputs + (r % MATRICES) * size;
+            memcpy(buf, cov, (m * m + m) * sizeof(double));
+            memcpy(buf + m * m + m, cov + m * m, m * sizeof(double));
+            if (!calc_cholesky_decomposition(buf, m))
+                sink += calc_quadratic_form(buf + m * m, buf + m * m + m, buf,
+                                                m);
+        }
+        double generic = (now() - start) / REPEATS;
+        start = now();
+        for (int r = 0; r < REPEATS; ++r) {
+            double *cov = inputs + (r % MATRICES) * size;
+            double  form;
+            if (!calc_small_quadratic_form(cov, cov + m * m, m, &form))
+                sink += form;
+        }
+        double kernel = (now() - start) / REPEATS;
+        printf("%2d  %12.1f  %11.1f  %6.2fx\n", m, 1e9 * generic, 1e9 * kernel,
+                   generic / kernel);
+    }
+    free(inputs);
+    return 0;
+}
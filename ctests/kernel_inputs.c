@@ -0,0 +1,82 @@
+/*
+ * kernel_inputs.c generates the random correlation matrices that the tests
+ * and benchmarks of the linear algebra kernels run on.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "kernel_inputs.h"
+
+#define PI 3.14159265358979323846
+
+static unsigned long long state = 88172645463325252ULL;
+
+/* uniform returns a uniform random number in (0, 1) (xorshift64) */
+static double uniform(void)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return ((state >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/* normal returns a standard normal random number (Box-Muller) */
+static double normal(void)
+{
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * PI * uniform());
+}
+
+/* normalize centers x and scales it to unit norm */
+static void normalize(double *x, int n)
+{
+    double mean = 0.0, norm = 0.0;
+    for (int i = 0; i < n; ++i)
+        mean += x[i];
+    mean /= n;
+    for (int i = 0; i < n; ++i) {
+        x[i] -= mean;
+        norm += x[i] * x[i];
+    }
+    norm = sqrt(norm);
+    for (int i = 0; i < n; ++i)
+        x[i] /= norm;
+}
+
+static double dot(const double *x, const double *y, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i)
+        sum += x[i] * y[i];
+    return sum;
+}
+
+void kernel_inputs(double *cov_xx, double *cov_xy, int m, int nobs,
+                       double collinearity)
+{
+    double *x = malloc((m + 1) * nobs * sizeof(double));
+    double *y = x + m * nobs;
+    for (int j = 0; j < m; ++j) {
+        double *x_j = x + j * nobs;
+        for (int i = 0; i < nobs; ++i)
+            x_j[i] = normal() + (j ? 0.5 * x_j[i - nobs] : 0.0);
+        if (collinearity > 0.0 && j == m - 1) {
+            for (int i = 0; i < nobs; ++i)
+                x_j[i] = x_j[i - nobs] + collinearity * normal();
+        }
+    }
+    for (int i = 0; i < nobs; ++i) {
+        y[i] = normal();
+        for (int j = 0; j < m; ++j)
+            y[i] += (j % 2 ? 0.3 : -0.2) * x[j * nobs + i];
+    }
+    for (int j = 0; j <= m; ++j)
+        normalize(x + j * nobs, nobs);
+    for (int j = 0; j < m; ++j) {
+        for (int k = 0; k < m; ++k)
+            cov_xx[j + m * k] = j == k ? 1.0 : dot(x + j * nobs, x + k * nobs,
+                                                      nobs);
+        cov_xy[j] = dot(x + j * nobs, y, nobs);
+    }
+    free(x);
+}
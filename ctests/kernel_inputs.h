@@ -0,0 +1,14 @@
+#ifndef KERNEL_INPUTS_H
+#define KERNEL_INPUTS_H
+
+/*
+ * kernel_inputs fills cov_xx (m x m) and cov_xy (m) with the correlations of
+ * m random variables and a response, estimated from nobs observations, as
+ * calculate_rss receives them. If collinearity is positive, the last variable
+ * is the one before it plus noise with that standard deviation, which makes
+ * cov_xx close to singular.
+ */
+void kernel_inputs(double *cov_xx, double *cov_xy, int m, int nobs,
+                       double collinearity);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * test_small_kernels.c checks that the kernels calc_small_quadratic_form
+ * specializes for 3 <= m <= SMALL_KERNEL_MAX agree with the generic path,
+ * calc_cholesky_decomposition followed by calc_quadratic_form, on random
+ * correlation matrices, both well conditioned and close to singular.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <scores/linearalgebra.h>
+
+#include "kernel_inputs.h"
+
+#define NOBS   200
+#define TRIALS 100
+
+/* the relative tolerance for the forms, by how close cov_xx is to singular */
+static const struct {
+    double collinearity;
+    double tolerance;
+} cases[] = {
+    {0.0,   1e-13}, /* well conditioned                           */
+    {1e-3,  1e-9},  /* condition numbers around 1e6               */
+    {1e-6,  1e-9},  /* around 1e12, where EPSILON starts to count */
+    {1e-12, 1e-9},  /* numerically singular                       */
+};
+
+/* generic_form is what calculate_rss did for every m >= 3 */
+static int generic_form(const double *cov_xx, const double *cov_xy, int m,
+                            double *form)
+{
+    double chol[SMALL_KERNEL_MAX * SMALL_KERNEL_MAX];
+    double xy[2 * SMALL_KERNEL_MAX];
+    memcpy(chol, cov_xx, m * m * sizeof(double));
+    /* calc_quadratic_form solves in place, and needs a copy of cov_xy */
+    memcpy(xy, cov_xy, m * sizeof(double));
+    memcpy(xy + m, cov_xy, m * sizeof(double));
+    int err = calc_cholesky_decomposition(chol, m);
+    if (!err)
+        *form = calc_quadratic_form(xy, xy + m, chol, m);
+    return err;
+}
+
+int main(void)
+{
+    double cov_xx[SMALL_KERNEL_MAX * SMALL_KERNEL_MAX];
+    double cov_xy[SMALL_KERNEL_MAX];
+    int    n_cases  = sizeof(cases) / sizeof(cases[0]);
+    int    failures = 0;
+    for (int c = 0; c < n_cases; ++c) {
+        for (int m = 3; m <= SMALL_KERNEL_MAX; ++m) {
+            double worst = 0.0;
+            for (int t = 0; t < TRIALS; ++t) {
+                kernel_inputs(cov_xx, cov_xy, m, NOBS, cases[c].collinearity);
+                double copy_xx[SMALL_KERNEL_MAX * SMALL_KERNEL_MAX];
+                double copy_xy[SMALL_KERNEL_MAX];
+                memcpy(copy_xx, cov_xx, sizeof(copy_xx));
+                memcpy(copy_xy, cov_xy, sizeof(copy_xy));
+                double small = 0.0, generic = 0.0;
+                int small_err   = calc_small_quadratic_form(cov_xx, cov_xy, m,
+                                                                &small);
+                int generic_err = generic_form(cov_xx, cov_xy, m, &generic);
+                if (memcmp(copy_xx, cov_xx, sizeof(copy_xx)) ||
+                        memcmp(copy_xy, cov_xy, sizeof(copy_xy))) {
+                    printf("FAIL m = %d: the kernel modified its input\n", m);
+                    failures++;
+                }
+                if (small_err != generic_err) {
+                    printf("FAIL m = %d: kernel returned %d, generic %d\n", m,
+                               small_err, generic_err);
+                    failures++;
+                    continue;
+                }
+                if (small_err)
+                    continue;
+                double diff = fabs(small - generic) / fmax(1.0, fabs(generic));
+                if (diff > worst)
+                    worst = diff;
+            }
+            if (worst > cases[c].tolerance) {
+                printf("FAIL m = %d, collinearity %g: relative difference "
+                           "%.3g > %.3g\n", m, cases[c].collinearity, worst,
+                           cases[c].tolerance);
+                failures++;
+            }
+        }
+    }
+    if (failures) {
+        printf("test_small_kernels: %d failures\n", failures);
+        return 1;
+    }
+    printf("test_small_kernels: passed\n");
+    return 0;
+}
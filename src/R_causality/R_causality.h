@@ -19,14 +19,36 @@ SEXP r_causality_chickering(SEXP graph);
 
 /* core algorithms */
 SEXP r_causality_score_graph(SEXP Graph, SEXP Df, SEXP ScoreType, SEXP States,
-                                     SEXP FloatingArgs, SEXP IntegerArgs);
+                                     SEXP FloatingArgs, SEXP IntegerArgs,
+                                     SEXP Nobs);
 SEXP r_causality_aggregate_graphs(SEXP graphs, SEXP graph_weights);
+SEXP r_causality_write_data(SEXP Df, SEXP States, SEXP File);
+SEXP r_causality_create_data_file(SEXP Names, SEXP States, SEXP Nobs,
+                                      SEXP File);
+SEXP r_causality_write_data_rows(SEXP Df, SEXP States, SEXP Start, SEXP File);
+SEXP r_causality_read_data_header(SEXP File);
+SEXP r_causality_create_statistics(SEXP States);
+SEXP r_causality_accumulate_statistics(SEXP Ptr, SEXP Df, SEXP States);
+SEXP r_causality_merge_statistics(SEXP A, SEXP B);
+SEXP r_causality_write_statistics(SEXP Ptr, SEXP File);
+SEXP r_causality_read_statistics(SEXP File);
 SEXP r_causality_ges(SEXP Df, SEXP ScoreType, SEXP States, SEXP FloatingArgs,
-                         SEXP IntegerArgs);
+                         SEXP IntegerArgs, SEXP Settings, SEXP Knowledge,
+                         SEXP Initial, SEXP Nobs, SEXP Tolerance);
+SEXP r_causality_update_ges(SEXP Ptr, SEXP Statistics, SEXP Names);
 
 /* dataframe functions */
-struct dataframe *prepare_dataframe(SEXP Df, SEXP States);
+struct dataframe *prepare_dataframe(SEXP Df, SEXP States, int nthreads);
+struct dataframe *prepare_covariance_dataframe(SEXP Cov, SEXP States,
+                                                   int nobs);
 void free_dataframe(struct dataframe *df);
+struct dataframe *open_dataframe(SEXP Df, SEXP States, SEXP Nobs,
+                                     int nthreads);
+SEXP dataframe_names(struct dataframe *df, SEXP Df);
+void close_dataframe(struct dataframe *df, SEXP Df);
+struct suff_stats * suff_stats_from_r(SEXP Statistics);
+
+#define STATISTICS_CLASS "causality.statistics"
 
 /* conversion functions to/from R/causality */
 void calculate_edges_from_cgraph(struct cgraph *cg, SEXP graph);
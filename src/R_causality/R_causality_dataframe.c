@@ -2,35 +2,51 @@
  * Date  : 3/8/2019
  * Description: r_causality_dataframe.c implements an R interface to the
  * causality dataframe structure, which is causality's internal storage for
- * dataframes. Notably on Unix systems, prepare_dataframe uses alligned memory
- * allocation for better loop vectorization. This is more helpful on
- * older architectures.
+ * dataframes. Notably, prepare_dataframe uses alligned memory allocation for
+ * better loop vectorization. This is more helpful on older architectures.
  */
 
-#ifdef __WIN32__
+#ifdef _WIN32
+#include <malloc.h>
 #else
 #define _POSIX_C_SOURCE 200112L
 #endif
 
 #include <dataframe.h>
 #include <causality.h>
+#include <data/data_file.h>
+#include <data/suff_stats.h>
+#include <scores/linearalgebra.h>
 #include <R_causality/R_causality.h>
 
-/* normalize a numeric variable */
-static void normalize(double *x, int n)
+/* column_stride returns the padded size of column i, in bytes */
+static size_t column_stride(struct dataframe *df, int i)
 {
-    double mu = 0.0f;
-    for (int i = 0; i < n; ++i)
-        mu += x[i];
-    mu /= n;
-    double var = 0.0f;
-    for (int i = 0; i < n; ++i) {
-        x[i] -= mu;
-        var += x[i] * x[i];
-    }
-    var = 1 / sqrt(var / (n - 1));
-    for (int i = 0; i < n; ++i)
-        x[i] *= var;
+    size_t size = df->states[i] ? sizeof(int) : sizeof(double);
+    size *= df->nobs;
+    return (size + DATAFRAME_ALIGNMENT - 1) / DATAFRAME_ALIGNMENT *
+               DATAFRAME_ALIGNMENT;
+}
+
+static void * aligned_slab(size_t size)
+{
+    #ifdef _WIN32
+    return _aligned_malloc(size, DATAFRAME_ALIGNMENT);
+    #else
+    void *slab;
+    if (posix_memalign(&slab, DATAFRAME_ALIGNMENT, size))
+        return NULL;
+    return slab;
+    #endif
+}
+
+static void free_slab(void *slab)
+{
+    #ifdef _WIN32
+    _aligned_free(slab);
+    #else
+    free(slab);
+    #endif
 }
 
 /*
@@ -41,42 +57,56 @@ static void normalize(double *x, int n)
  * the type (real or discrete/integer)of the variable in the data frame.
  * Instead, we store the columns as void pointers in df. This helps divorce
  * C and R so it is easier to port this package to python, julia, etc.
+ *
+ * All of the columns are stored in one slab of memory, each starting on a
+ * DATAFRAME_ALIGNMENT byte boundary, so wide datasets do not need an
+ * allocation (and pages) per column. The columns are copied, and the
+ * continuous ones normalized, in parallel using nthreads threads.
  */
-struct dataframe *prepare_dataframe(SEXP Df, SEXP States)
+struct dataframe *prepare_dataframe(SEXP Df, SEXP States, int nthreads)
 {
     struct dataframe *df = malloc(sizeof(struct dataframe));
+    const void **src = NULL;
     if (!df)
         goto ERR;
     df->nvar   = length(Df);
     df->nobs   = length(VECTOR_ELT(Df, 0));
     df->states = INTEGER(States);
+    df->cov    = NULL;
+    df->weights = NULL;
+    df->adtree  = NULL;
     df->df   = calloc(df->nvar, sizeof(void *));
-    if (!df->df)
+    src      = malloc(df->nvar * sizeof(void *));
+    if (!df->df || !src)
+        goto ERR;
+    size_t size = 0;
+    for (int i = 0; i < df->nvar; ++i)
+        size += column_stride(df, i);
+    char *slab = aligned_slab(size ? size : DATAFRAME_ALIGNMENT);
+    if (!slab)
         goto ERR;
+    /* the R API is not thread safe, so find the columns beforehand */
     for (int i = 0; i < df->nvar; ++i) {
         SEXP Df_i = VECTOR_ELT(Df, i);
-        if (df->states[i]) {
-            df->df[i] = malloc(df->nobs * sizeof(int));
-            if (!df->df[i])
-                goto ERR;
-            memcpy(df->df[i], INTEGER(Df_i), df->nobs * sizeof(int));
-        }
-        else {
-            #ifdef _WIN32
-            df->df[i] = malloc(df->nobs *sizeof(double));
-            if (!df->df[i])
-                goto ERR;
-            #else
-            if (posix_memalign(&df->df[i], 32, df->nobs * sizeof(double)))
-                goto ERR;
-            #endif
-            memcpy(df->df[i], REAL(Df_i), df->nobs * sizeof(double));
-            normalize(df->df[i], df->nobs);
-        }
+        if (df->states[i])
+            src[i] = INTEGER(Df_i);
+        else
+            src[i] = REAL(Df_i);
+        df->df[i] = slab;
+        slab     += column_stride(df, i);
     }
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic, 16)
+    for (int i = 0; i < df->nvar; ++i) {
+        if (df->states[i])
+            memcpy(df->df[i], src[i], df->nobs * sizeof(int));
+        else
+            calc_normalized_copy(df->df[i], src[i], df->nobs);
+    }
+    free(src);
     if (0) {
         ERR:
         CAUSALITY_ERROR("Failed to allocate memory for causality dataframe.");
+        free(src);
         if (!df)
             return df;
         free_dataframe(df);
@@ -85,12 +115,186 @@ struct dataframe *prepare_dataframe(SEXP Df, SEXP States)
     return df;
 }
 
+/*
+ * prepare_covariance_dataframe creates a dataframe that only holds the
+ * sufficient statistics of continuous data: the covariance matrix Cov, which
+ * is rescaled into a correlation matrix (the equivalent of normalizing the
+ * columns), and the number of observations nobs. There are no columns, so
+ * only the BIC scores can use it.
+ */
+struct dataframe *prepare_covariance_dataframe(SEXP Cov, SEXP States,
+                                                   int nobs)
+{
+    struct dataframe *df = calloc(1, sizeof(struct dataframe));
+    if (!df)
+        goto ERR;
+    int nvar   = ncols(Cov);
+    df->nvar   = nvar;
+    df->nobs   = nobs;
+    df->states = INTEGER(States);
+    df->cov    = malloc((size_t) nvar * nvar * sizeof(double));
+    double *sd = malloc(nvar * sizeof(double));
+    if (!df->cov || !sd) {
+        free(sd);
+        goto ERR;
+    }
+    double *cov = REAL(Cov);
+    for (int i = 0; i < nvar; ++i)
+        sd[i] = 1 / sqrt(cov[i + (size_t) nvar * i]);
+    for (int i = 0; i < nvar; ++i) {
+        double *cov_i = df->cov + (size_t) i * nvar;
+        for (int j = 0; j < nvar; ++j)
+            cov_i[j] = cov[i + (size_t) nvar * j] * sd[i] * sd[j];
+        cov_i[i] = 1.0f;
+    }
+    free(sd);
+    return df;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for causality dataframe.");
+    if (df)
+        free_dataframe(df);
+    return NULL;
+}
+
+/*
+ * open_dataframe prepares the data passed from R, which is a data.frame, the
+ * path to a causality data file, sufficient statistics, or, if Nobs is not
+ * NULL, a covariance matrix. A data.frame is copied using nthreads threads.
+ * It must be freed with close_dataframe.
+ */
+struct dataframe *open_dataframe(SEXP Df, SEXP States, SEXP Nobs,
+                                     int nthreads)
+{
+    if (inherits(Df, STATISTICS_CLASS))
+        return suff_stats_dataframe(suff_stats_from_r(Df));
+    else if (isString(Df))
+        return map_data_file(CHAR(STRING_ELT(Df, 0)));
+    else if (!isNull(Nobs))
+        return prepare_covariance_dataframe(Df, States, asInteger(Nobs));
+    else
+        return prepare_dataframe(Df, States, nthreads);
+}
+
+/* dataframe_names returns the variable names of the data opened from Df */
+SEXP dataframe_names(struct dataframe *df, SEXP Df)
+{
+    if (inherits(Df, STATISTICS_CLASS))
+        return VECTOR_ELT(Df, 1);
+    else if (isString(Df)) {
+        SEXP Names = PROTECT(allocVector(STRSXP, df->nvar));
+        for (int i = 0; i < df->nvar; ++i)
+            SET_STRING_ELT(Names, i, mkChar(data_file_name(df, i)));
+        UNPROTECT(1);
+        return Names;
+    }
+    else if (isMatrix(Df))
+        return VECTOR_ELT(getAttrib(Df, R_DimNamesSymbol), 1);
+    else
+        return getAttrib(Df, R_NamesSymbol);
+}
+
+void close_dataframe(struct dataframe *df, SEXP Df)
+{
+    if (inherits(Df, STATISTICS_CLASS))
+        free_suff_stats_dataframe(df);
+    else if (isString(Df))
+        unmap_data_file(df);
+    else
+        free_dataframe(df);
+}
+
+/*
+ * r_causality_write_data converts the data.frame Df into a causality data
+ * file at File, normalizing its continuous columns.
+ */
+SEXP r_causality_write_data(SEXP Df, SEXP States, SEXP File)
+{
+    struct dataframe *df = prepare_dataframe(Df, States, 1);
+    if (!df)
+        return ScalarLogical(FALSE);
+    SEXP Names = getAttrib(Df, R_NamesSymbol);
+    const char **names = malloc(df->nvar * sizeof(char *));
+    for (int i = 0; i < df->nvar; ++i)
+        names[i] = CHAR(STRING_ELT(Names, i));
+    int err = write_data_file(CHAR(STRING_ELT(File, 0)), df, names);
+    free(names);
+    free_dataframe(df);
+    return ScalarLogical(!err);
+}
+
+/*
+ * r_causality_create_data_file creates a causality data file at File for Nobs
+ * rows of the variables Names, which have States, and leaves its columns
+ * empty for r_causality_write_data_rows to fill.
+ */
+SEXP r_causality_create_data_file(SEXP Names, SEXP States, SEXP Nobs,
+                                      SEXP File)
+{
+    struct dataframe df = {.states = INTEGER(States), .nvar = length(Names),
+                           .nobs = asInteger(Nobs)};
+    const char **names = malloc(df.nvar * sizeof(char *));
+    if (!names)
+        return ScalarLogical(FALSE);
+    for (int i = 0; i < df.nvar; ++i)
+        names[i] = CHAR(STRING_ELT(Names, i));
+    int err = create_data_file(CHAR(STRING_ELT(File, 0)), &df, names);
+    free(names);
+    return ScalarLogical(!err);
+}
+
+/*
+ * r_causality_write_data_rows writes the data.frame Df into the rows of the
+ * causality data file File that start at row Start (from 0). The columns of
+ * Df must already be converted, and the continuous ones normalized, so they
+ * are written straight from R's memory instead of being copied.
+ */
+SEXP r_causality_write_data_rows(SEXP Df, SEXP States, SEXP Start, SEXP File)
+{
+    struct dataframe df = {.states = INTEGER(States), .nvar = length(Df),
+                           .nobs = length(VECTOR_ELT(Df, 0))};
+    df.df = malloc(df.nvar * sizeof(void *));
+    if (!df.df)
+        return ScalarLogical(FALSE);
+    for (int i = 0; i < df.nvar; ++i) {
+        SEXP Df_i = VECTOR_ELT(Df, i);
+        if (df.states[i])
+            df.df[i] = INTEGER(Df_i);
+        else
+            df.df[i] = REAL(Df_i);
+    }
+    int err = write_data_rows(CHAR(STRING_ELT(File, 0)), &df,
+                                  asInteger(Start));
+    free(df.df);
+    return ScalarLogical(!err);
+}
+
+/*
+ * r_causality_read_data_header returns the names and number of states of the
+ * variables in the causality data file File, or NULL if it cannot be read.
+ */
+SEXP r_causality_read_data_header(SEXP File)
+{
+    struct dataframe *df = map_data_file(CHAR(STRING_ELT(File, 0)));
+    if (!df)
+        return R_NilValue;
+    SEXP Header = PROTECT(allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(Header, 0, dataframe_names(df, File));
+    SET_VECTOR_ELT(Header, 1, allocVector(INTSXP, df->nvar));
+    memcpy(INTEGER(VECTOR_ELT(Header, 1)), df->states,
+               df->nvar * sizeof(int));
+    unmap_data_file(df);
+    UNPROTECT(1);
+    return Header;
+}
+
 void free_dataframe(struct dataframe *df)
 {
+    /* the columns share one slab, which starts with the first column */
     if (df->df) {
-        for (int i = 0; i < df->nvar; ++i)
-            free(df->df[i]);
+        if (df->nvar)
+            free_slab(df->df[0]);
         free(df->df);
     }
+    free(df->cov);
     free(df);
 }
@@ -5,9 +5,228 @@
 #include <cgraph/cgraph.h>
 #include <scores/scores.h>
 #include <ges/ges_internal.h>
+#include <data/data_file.h>
+#include <data/suff_stats.h>
+#include <data/adtree.h>
 
+/* positions of the search settings in the integer vector Settings */
+#define FGES_SETTING         0
+#define FAITHFULNESS_SETTING 1
+#define NTHREADS_SETTING     2
+#define CANDIDATES_SETTING   3
+#define SCREENING_SETTING    4
+#define MAX_PARENTS_SETTING  5
+#define MAX_DEGREE_SETTING   6
+#define ADTREE_SETTING       7
+#define LEAF_SETTING         8
+
+/*
+ * knowledge_from_r creates the background knowledge described by the R list
+ * Knowledge, which contains the tier of each variable and the forbidden and
+ * required edges as vectors of (zero indexed) node pairs. Any of them may be
+ * NULL. Returns NULL if there is no knowledge.
+ */
+static struct ges_knowledge * knowledge_from_r(SEXP Knowledge, int n_nodes)
+{
+    SEXP Tiers     = VECTOR_ELT(Knowledge, 0);
+    SEXP Forbidden = VECTOR_ELT(Knowledge, 1);
+    SEXP Required  = VECTOR_ELT(Knowledge, 2);
+    if (isNull(Tiers) && isNull(Forbidden) && isNull(Required))
+        return NULL;
+    struct ges_knowledge *know = create_ges_knowledge(n_nodes);
+    if (!know)
+        return NULL;
+    if (!isNull(Tiers) && set_ges_tiers(know, INTEGER(Tiers))) {
+        free_ges_knowledge(know);
+        return NULL;
+    }
+    if (!isNull(Forbidden)) {
+        int *edges = INTEGER(Forbidden);
+        for (int i = 0; i < length(Forbidden); i += 2)
+            forbid_ges_edge(know, edges[i], edges[i + 1]);
+    }
+    if (!isNull(Required)) {
+        int *edges = INTEGER(Required);
+        for (int i = 0; i < length(Required); i += 2)
+            require_ges_edge(know, edges[i], edges[i + 1]);
+    }
+    return know;
+}
+
+/*
+ * ges_path_output runs the penalty path of GES over the penalties in
+ * Penalties, and returns the list of learned patterns and their scores.
+ */
+static SEXP ges_path_output(struct ges_score score, SEXP Penalties,
+                                struct cgraph *cg, struct ges_settings *settings,
+                                SEXP Names)
+{
+    int n = length(Penalties);
+    struct cgraph **cgs = calloc(n, sizeof(struct cgraph *));
+    SEXP Output = PROTECT(allocVector(VECSXP, 2));
+    SEXP Graphs = PROTECT(allocVector(VECSXP, n));
+    SEXP Scores = PROTECT(allocVector(REALSXP, n));
+    if (!cgs || ccf_ges_path(score, REAL(Penalties), n, cg, settings, cgs,
+                                 REAL(Scores))) {
+        free(cgs);
+        UNPROTECT(3);
+        return R_NilValue;
+    }
+    SEXP Class = PROTECT(allocVector(STRSXP, 2));
+    SET_STRING_ELT(Class, 0, mkChar("causality.pattern"));
+    SET_STRING_ELT(Class, 1, mkChar("causality.graph"));
+    for (int i = 0; i < n; ++i) {
+        SET_VECTOR_ELT(Graphs, i, causality_graph_from_cgraph(cgs[i], Names));
+        setAttrib(VECTOR_ELT(Graphs, i), R_ClassSymbol, Class);
+        free_cgraph(cgs[i]);
+    }
+    free(cgs);
+    SET_VECTOR_ELT(Output, 0, Graphs);
+    SET_VECTOR_ELT(Output, 1, Scores);
+    UNPROTECT(4);
+    return Output;
+}
+
+static SEXP pattern_from_cgraph(struct cgraph *cg, SEXP Names)
+{
+    SEXP Graph = PROTECT(causality_graph_from_cgraph(cg, Names));
+    SEXP Class = PROTECT(allocVector(STRSXP, 2));
+    SET_STRING_ELT(Class, 0, mkChar("causality.pattern"));
+    SET_STRING_ELT(Class, 1, mkChar("causality.graph"));
+    setAttrib(Graph, R_ClassSymbol, Class);
+    UNPROTECT(2);
+    return Graph;
+}
+
+/*
+ * r_ges_session is a GES session held by R, along with everything the session
+ * needs to outlive it: the dataframe of the last batch, the arguments of the
+ * score, and the background knowledge.
+ */
+struct r_ges_session {
+    struct ges_session   *session;
+    struct dataframe     *df;
+    struct score_args     args;
+    struct ges_knowledge *knowledge;
+};
+
+static void free_r_ges_session(struct r_ges_session *rs)
+{
+    if (rs->session)
+        free_ges_session(rs->session);
+    if (rs->df)
+        free_suff_stats_dataframe(rs->df);
+    if (rs->knowledge)
+        free_ges_knowledge(rs->knowledge);
+    free(rs->args.fargs);
+    free(rs);
+}
+
+static void finalize_ges_session(SEXP Ptr)
+{
+    struct r_ges_session *rs = R_ExternalPtrAddr(Ptr);
+    if (rs) {
+        free_r_ges_session(rs);
+        R_ClearExternalPtr(Ptr);
+    }
+}
+
+/*
+ * ges_session_output creates a GES session on the sufficient statistics in
+ * df, and returns the learned pattern, its score, the search statistics, and
+ * the session. The session takes ownership of df and settings->knowledge.
+ */
+static SEXP ges_session_output(struct ges_score score, SEXP FloatingArgs,
+                                   struct cgraph *cg,
+                                   struct ges_settings *settings,
+                                   SEXP Tolerance, SEXP Names)
+{
+    struct r_ges_session *rs = calloc(1, sizeof(struct r_ges_session));
+    if (!rs) {
+        free_suff_stats_dataframe(score.df);
+        if (settings->knowledge)
+            free_ges_knowledge(settings->knowledge);
+        return R_NilValue;
+    }
+    rs->df        = score.df;
+    rs->knowledge = settings->knowledge;
+    /* the arguments of the score are copied out of R */
+    int n_fargs = length(FloatingArgs);
+    rs->args.fargs = malloc(n_fargs * sizeof(double));
+    if (!rs->args.fargs) {
+        free_r_ges_session(rs);
+        return R_NilValue;
+    }
+    memcpy(rs->args.fargs, REAL(FloatingArgs), n_fargs * sizeof(double));
+    score.args = &rs->args;
+    struct ges_stats stats;
+    double graph_score;
+    rs->session = create_ges_session(score, cg, settings, asReal(Tolerance),
+                                         &graph_score, &stats);
+    if (!rs->session) {
+        free_r_ges_session(rs);
+        return R_NilValue;
+    }
+    SEXP Ptr = PROTECT(R_MakeExternalPtr(rs, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(Ptr, finalize_ges_session, TRUE);
+    struct cgraph *pattern = ges_session_graph(rs->session);
+    SEXP Output = PROTECT(allocVector(VECSXP, 6));
+    SET_VECTOR_ELT(Output, 0, pattern_from_cgraph(pattern, Names));
+    SET_VECTOR_ELT(Output, 1, ScalarReal(graph_score));
+    SET_VECTOR_ELT(Output, 2, ScalarInteger(stats.n_effect_edges));
+    SET_VECTOR_ELT(Output, 3, ScalarReal(stats.n_pruned));
+    SET_VECTOR_ELT(Output, 4, ScalarReal(stats.subset_pruning));
+    SET_VECTOR_ELT(Output, 5, Ptr);
+    free_cgraph(pattern);
+    UNPROTECT(2);
+    return Output;
+}
+
+/*
+ * r_causality_update_ges updates the GES session in Ptr with the sufficient
+ * statistics Statistics, to which new data has been added, and returns the
+ * repaired pattern, the change in its score, and how many nodes were
+ * rescored, or NULL if the session could not be updated.
+ */
+SEXP r_causality_update_ges(SEXP Ptr, SEXP Statistics, SEXP Names)
+{
+    struct r_ges_session *rs = R_ExternalPtrAddr(Ptr);
+    if (!rs)
+        return R_NilValue;
+    struct dataframe *df = suff_stats_dataframe(suff_stats_from_r(Statistics));
+    if (!df)
+        return R_NilValue;
+    struct ges_stats stats;
+    double score_diff;
+    /* on failure the session still scores the previous batch */
+    if (update_ges_session(rs->session, df, &score_diff, &stats)) {
+        free_suff_stats_dataframe(df);
+        return R_NilValue;
+    }
+    /* the session now scores df, so the previous batch can be freed */
+    free_suff_stats_dataframe(rs->df);
+    rs->df = df;
+    struct cgraph *pattern = ges_session_graph(rs->session);
+    SEXP Output = PROTECT(allocVector(VECSXP, 3));
+    SET_VECTOR_ELT(Output, 0, pattern_from_cgraph(pattern, Names));
+    SET_VECTOR_ELT(Output, 1, ScalarReal(score_diff));
+    SET_VECTOR_ELT(Output, 2, ScalarInteger(stats.n_rescored));
+    free_cgraph(pattern);
+    UNPROTECT(1);
+    return Output;
+}
+
+/*
+ * r_causality_ges runs GES on the data frame Df. Df may instead be the path
+ * to a causality data file, sufficient statistics, or, if Nobs is not NULL,
+ * the covariance matrix (with column names) of a continuous dataset with Nobs
+ * observations. If Tolerance is not NULL, Df must be sufficient statistics,
+ * and the search is kept as a session that can be updated with new data.
+ */
 SEXP r_causality_ges(SEXP Df, SEXP ScoreType, SEXP States,
-                           SEXP FloatingArgs, SEXP IntegerArgs)
+                           SEXP FloatingArgs, SEXP IntegerArgs, SEXP Settings,
+                           SEXP Knowledge, SEXP Initial, SEXP Nobs,
+                           SEXP Tolerance)
 {
     /*
      * calculate the integer arguments and floating point arguments for the
@@ -30,34 +249,86 @@ SEXP r_causality_ges(SEXP Df, SEXP ScoreType, SEXP States,
         CAUSALITY_ERROR("Score not recognized.\n");
         return R_NilValue;
     }
-    struct dataframe *df = prepare_dataframe(Df, States);
+    int nthreads = INTEGER(Settings)[NTHREADS_SETTING];
+    struct dataframe *df = open_dataframe(Df, States, Nobs, nthreads);
     if (!df) {
         CAUSALITY_ERROR("Failed to prepare dataframe for GES.\n");
         return R_NilValue;
     }
-    struct score_args args = {fargs, iargs};
+    SEXP Names = PROTECT(dataframe_names(df, Df));
+    struct score_args args = {.fargs = fargs, .iargs = iargs};
     struct ges_score score = {ges_score, {0}, df, &args};
+    struct ges_settings settings;
+    settings.fges           = INTEGER(Settings)[FGES_SETTING];
+    settings.faithfulness   = INTEGER(Settings)[FAITHFULNESS_SETTING];
+    settings.nthreads       = INTEGER(Settings)[NTHREADS_SETTING];
+    settings.max_candidates = INTEGER(Settings)[CANDIDATES_SETTING];
+    settings.screening      = INTEGER(Settings)[SCREENING_SETTING];
+    settings.max_parents    = INTEGER(Settings)[MAX_PARENTS_SETTING];
+    settings.max_degree     = INTEGER(Settings)[MAX_DEGREE_SETTING];
+    settings.knowledge      = knowledge_from_r(Knowledge, df->nvar);
+    struct ges_stats stats;
+    /* stream the covariances out of a data file once, instead of per score */
+    if (isString(Df) && ges_score == ges_bic_score &&
+            stream_covariance_matrix(df, settings.nthreads)) {
+        close_dataframe(df, Df);
+        UNPROTECT(1);
+        return R_NilValue;
+    }
     /*
      * All the preprocessing work has now been done, so lets instantiate
-     * an empty graph and run FGES.
+     * the initial graph (empty unless one was given) and run FGES.
      */
-    struct cgraph *cg      = create_cgraph(df->nvar);
-    double graph_score = ccf_ges(score, cg);
-    free_dataframe(df);
-    if (!cg)
+    struct cgraph *cg;
+    if (isNull(Initial))
+        cg = create_cgraph(df->nvar);
+    else
+        cg = cgraph_from_causality_graph(Initial);
+    if (!isNull(Tolerance)) {
+        SEXP Output = PROTECT(ges_session_output(score, FloatingArgs, cg,
+                                                     &settings, Tolerance,
+                                                     Names));
+        free_cgraph(cg);
+        UNPROTECT(2);
+        return Output;
+    }
+    /* with more than one BIC penalty, run the penalty path instead */
+    if (ges_score == ges_bic_score && length(FloatingArgs) > 1) {
+        SEXP Output = PROTECT(ges_path_output(score, FloatingArgs, cg,
+                                                  &settings, Names));
+        free_cgraph(cg);
+        close_dataframe(df, Df);
+        if (settings.knowledge)
+            free_ges_knowledge(settings.knowledge);
+        UNPROTECT(2);
+        return Output;
+    }
+    /* for discrete data, count from an adtree if it fits in its budget */
+    int adtree_budget = INTEGER(Settings)[ADTREE_SETTING];
+    if (adtree_budget > 0 && ges_score != ges_bic_score)
+        df->adtree = create_adtree(df, (size_t) adtree_budget << 20,
+                                       INTEGER(Settings)[LEAF_SETTING]);
+    double graph_score = ccf_ges(score, cg, &settings, &stats);
+    if (df->adtree) {
+        free_adtree(df->adtree);
+        df->adtree = NULL;
+    }
+    close_dataframe(df, Df);
+    if (settings.knowledge)
+        free_ges_knowledge(settings.knowledge);
+    if (!cg) {
+        UNPROTECT(1);
         return R_NilValue;
-    /* Create R causality.graph object from cg */
-    SEXP Output = PROTECT(allocVector(VECSXP, 2));
-    SEXP Names  = PROTECT(getAttrib(Df, R_NamesSymbol));
-    SET_VECTOR_ELT(Output, 0, causality_graph_from_cgraph(cg, Names));
+    }
+    /* Create R causality.pattern object from cg */
+    SEXP Output = PROTECT(allocVector(VECSXP, 5));
+    SET_VECTOR_ELT(Output, 0, pattern_from_cgraph(cg, Names));
     SET_VECTOR_ELT(Output, 1, ScalarReal(graph_score));
+    SET_VECTOR_ELT(Output, 2, ScalarInteger(stats.n_effect_edges));
+    SET_VECTOR_ELT(Output, 3, ScalarReal(stats.n_pruned));
+    SET_VECTOR_ELT(Output, 4, ScalarReal(stats.subset_pruning));
     free_cgraph(cg);
-    /* Set the output of GES to the class causality.pattern */
-    SEXP Class = PROTECT(allocVector(STRSXP, 2));
-    SET_STRING_ELT(Class, 0, mkChar("causality.pattern"));
-    SET_STRING_ELT(Class, 1, mkChar("causality.graph"));
-    setAttrib(VECTOR_ELT(Output, 0), R_ClassSymbol, Class);
     /* Return the graph and its score */
-    UNPROTECT(3);
+    UNPROTECT(2);
     return Output;
 }
@@ -0,0 +1,89 @@
+/*
+ * R_causality_statistics.c implements the R interface to sufficient
+ * statistics. The statistics live in C, and R holds them through an external
+ * pointer, which frees them when it is garbage collected.
+ */
+
+#include <R_causality/R_causality.h>
+
+#include <causality.h>
+#include <dataframe.h>
+#include <data/suff_stats.h>
+
+static void finalize_statistics(SEXP Ptr)
+{
+    struct suff_stats *ss = R_ExternalPtrAddr(Ptr);
+    if (ss) {
+        free_suff_stats(ss);
+        R_ClearExternalPtr(Ptr);
+    }
+}
+
+static SEXP statistics_pointer(struct suff_stats *ss)
+{
+    if (!ss)
+        return R_NilValue;
+    SEXP Ptr = PROTECT(R_MakeExternalPtr(ss, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(Ptr, finalize_statistics, TRUE);
+    UNPROTECT(1);
+    return Ptr;
+}
+
+struct suff_stats * suff_stats_from_r(SEXP Statistics)
+{
+    return R_ExternalPtrAddr(VECTOR_ELT(Statistics, 0));
+}
+
+SEXP r_causality_create_statistics(SEXP States)
+{
+    return statistics_pointer(create_suff_stats(length(States),
+                                                    INTEGER(States)));
+}
+
+/*
+ * r_causality_accumulate_statistics adds the data.frame Df, whose columns are
+ * doubles (continuous) or zero indexed integers (discrete), to the statistics
+ * in Ptr. The columns are used in place, without being copied.
+ */
+SEXP r_causality_accumulate_statistics(SEXP Ptr, SEXP Df, SEXP States)
+{
+    struct suff_stats *ss = R_ExternalPtrAddr(Ptr);
+    struct dataframe chunk = {0};
+    chunk.nvar   = length(Df);
+    chunk.nobs   = length(VECTOR_ELT(Df, 0));
+    chunk.states = INTEGER(States);
+    chunk.df     = malloc(chunk.nvar * sizeof(void *));
+    if (!ss || !chunk.df) {
+        free(chunk.df);
+        return ScalarLogical(FALSE);
+    }
+    for (int i = 0; i < chunk.nvar; ++i) {
+        SEXP Df_i = VECTOR_ELT(Df, i);
+        if (chunk.states[i])
+            chunk.df[i] = INTEGER(Df_i);
+        else
+            chunk.df[i] = REAL(Df_i);
+    }
+    int err = accumulate_suff_stats(ss, &chunk);
+    free(chunk.df);
+    return ScalarLogical(!err);
+}
+
+SEXP r_causality_merge_statistics(SEXP A, SEXP B)
+{
+    struct suff_stats *a = R_ExternalPtrAddr(A);
+    struct suff_stats *b = R_ExternalPtrAddr(B);
+    return ScalarLogical(a && b && !merge_suff_stats(a, b));
+}
+
+SEXP r_causality_write_statistics(SEXP Ptr, SEXP File)
+{
+    struct suff_stats *ss = R_ExternalPtrAddr(Ptr);
+    return ScalarLogical(ss && !write_suff_stats(ss,
+                                                 CHAR(STRING_ELT(File, 0))));
+}
+
+SEXP r_causality_read_statistics(SEXP File)
+{
+    return statistics_pointer(read_suff_stats(CHAR(STRING_ELT(File, 0))));
+}
@@ -1,6 +1,7 @@
 #include <R_causality/R_causality.h>
 #include <causality.h>
 #include <scores/scores.h>
+#include <data/data_file.h>
 
 /*
  * causalitySort takes in an R object, proccesses it down to the C level
@@ -69,11 +70,16 @@ SEXP r_causality_meek(SEXP pdag)
     return cpdag;
 }
 
+/*
+ * Df may be a data.frame, the path to a causality data file, or, if Nobs is
+ * not NULL, the covariance matrix of a dataset with Nobs observations.
+ */
 SEXP r_causality_score_graph(SEXP Graph, SEXP Df, SEXP ScoreType, SEXP States,
-                                         SEXP FloatingArgs, SEXP IntegerArgs)
+                                         SEXP FloatingArgs, SEXP IntegerArgs,
+                                         SEXP Nobs)
 {
     struct cgraph *cg = cgraph_from_causality_graph(Graph);
-    struct score_args args = {NULL, NULL};
+    struct score_args args = {.fargs = NULL, .iargs = NULL};
     score_func score;
     if (!strcmp(CHAR(STRING_ELT(ScoreType, 0)), BIC_SCORE))
         score = bic_score;
@@ -88,9 +94,19 @@ SEXP r_causality_score_graph(SEXP Graph, SEXP Df, SEXP ScoreType, SEXP States,
         args.iargs = INTEGER(IntegerArgs);
     if (!isNull(FloatingArgs))
         args.fargs = REAL(FloatingArgs);
-    struct dataframe *df = prepare_dataframe(Df, States);
+    struct dataframe *df = open_dataframe(Df, States, Nobs, 1);
+    if (!df) {
+        free_cgraph(cg);
+        return R_NilValue;
+    }
+    /* stream the covariances out of a data file once, instead of per score */
+    if (isString(Df) && score == bic_score && stream_covariance_matrix(df, 1)) {
+        close_dataframe(df, Df);
+        free_cgraph(cg);
+        return R_NilValue;
+    }
     double graph_score = causality_score_graph(cg, df, score, &args);
-    free_dataframe(df);
+    close_dataframe(df, Df);
     free_cgraph(cg);
     return ScalarReal(graph_score);
 }
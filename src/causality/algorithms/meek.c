@@ -7,88 +7,149 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <causality.h>
 #include <cgraph/cgraph.h>
 #include <cgraph/edge_list.h>
 #include <algorithms/meek.h>
 
-void push(struct stack **s, int node)
+/*
+ * create_worklist allocates a worklist that can hold capacity distinct nodes.
+ * It returns 0 on success and 1 if memory could not be allocated.
+ */
+int create_worklist(struct worklist *wl, int capacity)
 {
-    struct stack *tmp = malloc(sizeof(struct stack));
-    if (!tmp) {
-        CAUSALITY_ERROR("Failed to allocate node for stack in meek rules.\n");
-        while (*s) {
-            void *p = (*s)->next;
-            free(*s);
-            *s = p;
-        }
+    wl->head     = 0;
+    wl->size     = 0;
+    wl->capacity = capacity;
+    wl->nodes    = malloc(capacity * sizeof(int));
+    wl->queued   = calloc(capacity / 8 + 1, sizeof(unsigned char));
+    if (!wl->nodes || !wl->queued) {
+        CAUSALITY_ERROR("Failed to allocate memory for worklist.\n");
+        free_worklist(wl);
+        return 1;
     }
-    tmp->next = *s;
-    tmp->node = node;
-    *s = tmp;
+    return 0;
+}
+
+void free_worklist(struct worklist *wl)
+{
+    free(wl->nodes);
+    free(wl->queued);
+    wl->nodes  = NULL;
+    wl->queued = NULL;
+}
+
+/* enqueue_node adds node to the back of the ring if it is not already in it */
+void enqueue_node(struct worklist *wl, int node)
+{
+    unsigned char bit = 0x01 << (node % 8);
+    if (wl->queued[node / 8] & bit)
+        return;
+    wl->queued[node / 8] |= bit;
+    int tail = wl->head + wl->size;
+    if (tail >= wl->capacity)
+        tail -= wl->capacity;
+    wl->nodes[tail] = node;
+    wl->size += 1;
 }
 
-int pop(struct stack **s)
+/* dequeue_node removes the node at the front of the ring, or returns -1 */
+int dequeue_node(struct worklist *wl)
 {
-    if (*s == NULL)
+    if (wl->size == 0)
         return -1;
-    struct stack *tmp = *s;
-    int node = tmp->node;
-    *s = tmp->next;
-    free(tmp);
+    int node = wl->nodes[wl->head];
+    wl->queued[node / 8] &= ~(0x01 << (node % 8));
+    wl->head += 1;
+    if (wl->head == wl->capacity)
+        wl->head = 0;
+    wl->size -= 1;
     return node;
 }
 
+static const meek_rule MEEK_RULES[NUM_MEEK_RULES] = {meek_rule1, meek_rule2,
+                                                         meek_rule3, meek_rule4};
+
 /*
- * meek_rules take in a PDAG and maximially orients it by repeatedly applying
- * the four meek rules
- * it currently returns an updated edge matrix
+ * apply_rules applies the four meek rules, in order, to the undirected edges
+ * of y. Orientation occurs in place, so instead of copying the spouses of y we
+ * take a snapshot of them in the preallocated array spouses. An oriented edge
+ * is dropped from the snapshot, which keeps the snapshot in the same order as
+ * the spouse list. Both endpoints of an oriented edge are enqueued, as the
+ * rules at either endpoint can fire because of the new orientation.
  */
-void causality_meek(struct cgraph *cg)
+static void apply_rules(struct cgraph *cg, int y, struct worklist *wl,
+                            int *spouses, struct meek_stats *stats)
 {
-    struct stack *s = NULL;
-    for (int i = 0; i < cg->n_nodes; ++i) {
-        if (cg->spouses[i])
-            push(&s, i);
+    int n = 0;
+    struct edge_list *p = cg->spouses[y];
+    while (p) {
+        spouses[n++] = p->node;
+        p = p->next;
     }
-    int node;
-    while ((node = pop(&s)) >= 0) {
-        apply_rule(cg, node, &s, meek_rule1);
-        apply_rule(cg, node, &s, meek_rule2);
-        apply_rule(cg, node, &s, meek_rule3);
-        apply_rule(cg, node, &s, meek_rule4);
+    for (int i = 0; i < NUM_MEEK_RULES && n > 0; ++i) {
+        meek_rule meek_rule = MEEK_RULES[i];
+        int k = 0;
+        for (int j = 0; j < n; ++j) {
+            int x = spouses[j];
+            if (meek_rule(cg, x, y))
+                orient_undirected_edge(cg, x, y);
+            else if (meek_rule(cg, y, x))
+                orient_undirected_edge(cg, y, x);
+            else {
+                spouses[k++] = x;
+                continue;
+            }
+            enqueue_node(wl, x);
+            enqueue_node(wl, y);
+            stats->rule_firings[i]++;
+        }
+        n = k;
     }
 }
 
 /*
- * apply_rule applied the selected meek rule (passed in by function pointer)
- * it returns 1 if the rule was applied, and 0 if not
+ * meek_propagate takes in a PDAG and maximially orients it by repeatedly
+ * applying the four meek rules. Every node with an undirected edge starts on
+ * the worklist, and a node is revisited only when one of its edges is
+ * oriented. If stats is not NULL, the number of times each rule fired is
+ * recorded in it. meek_propagate returns 0 on success and 1 if memory could
+ * not be allocated, in which case cg is left unmodified.
  */
-void apply_rule(struct cgraph *cg, int y, struct stack **s,
-                                   meek_rule meek_rule)
+int meek_propagate(struct cgraph *cg, struct meek_stats *stats)
 {
-    /*
-     * we need to create a copy of spouses incase an edge is
-     * oriented -- orientation occurs "in place."
-     */
-    if (!cg->spouses[y])
-        return;
-    struct edge_list *cpy = copy_edge_list(cg->spouses[y]);
-    struct edge_list *p   = cpy;
-    while (p) {
-        int x = p->node;
-        if (meek_rule(cg, x, y)) {
-            orient_undirected_edge(cg, x, y);
-            push(s, y);
-        }
-        else if (meek_rule(cg, y, x)) {
-            orient_undirected_edge(cg, y, x);
-            push(s, x);
-        }
-        p = p->next;
+    struct meek_stats local_stats;
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(struct meek_stats));
+    struct worklist wl;
+    if (create_worklist(&wl, cg->n_nodes))
+        return 1;
+    int *spouses = malloc(cg->n_nodes * sizeof(int));
+    if (spouses == NULL) {
+        CAUSALITY_ERROR("Failed to allocate memory for meek rules.\n");
+        free_worklist(&wl);
+        return 1;
+    }
+    for (int i = 0; i < cg->n_nodes; ++i) {
+        if (cg->spouses[i])
+            enqueue_node(&wl, i);
+    }
+    int node;
+    while ((node = dequeue_node(&wl)) >= 0) {
+        stats->n_visits++;
+        apply_rules(cg, node, &wl, spouses, stats);
     }
-    free_edge_list(cpy);
+    free(spouses);
+    free_worklist(&wl);
+    return 0;
+}
+
+void causality_meek(struct cgraph *cg)
+{
+    meek_propagate(cg, NULL);
 }
 
 /*
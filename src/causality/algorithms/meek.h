@@ -4,18 +4,35 @@
 #include <stdlib.h>
 #include <cgraph/cgraph.h>
 
-struct stack {
-    int size;
-    int node;
-    struct stack *next;
+#define NUM_MEEK_RULES 4
+
+/*
+ * worklist is a fixed capacity FIFO ring of nodes. The queued bitmap records
+ * which nodes are currently in the ring, so a node is never enqueued twice.
+ * This bounds the size of the ring by the number of nodes in the graph.
+ */
+struct worklist {
+    int           *nodes;
+    unsigned char *queued;
+    int            head;
+    int            size;
+    int            capacity;
+};
+
+/* counters collected while propagating the meek rules */
+struct meek_stats {
+    unsigned long rule_firings[NUM_MEEK_RULES]; /* edges oriented by rule i */
+    unsigned long n_visits; /* number of nodes taken off of the worklist */
 };
 
 typedef int (*meek_rule)(struct cgraph *cg, int x, int y);
-/* node stack operations */
-void push(struct stack **s, int node);
-int pop(struct stack **s);
+/* node worklist operations */
+int  create_worklist(struct worklist *wl, int capacity);
+void free_worklist(struct worklist *wl);
+void enqueue_node(struct worklist *wl, int node);
+int  dequeue_node(struct worklist *wl);
 /* meek rules */
-void apply_rule(struct cgraph *cg, int x, struct stack **s, meek_rule rule);
+int meek_propagate(struct cgraph *cg, struct meek_stats *stats);
 int meek_rule1(struct cgraph *cg, int x, int y);
 int meek_rule2(struct cgraph *cg, int x, int y);
 int meek_rule3(struct cgraph *cg, int x, int y);
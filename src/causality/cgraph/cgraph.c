@@ -13,6 +13,7 @@ struct cgraph *create_cgraph(int n_nodes)
     }
     cg->n_edges  = 0;
     cg->n_nodes  = n_nodes;
+    cg->changes  = NULL;
     cg->parents  = calloc(n_nodes, sizeof(struct edge_list *));
     cg->children = calloc(n_nodes, sizeof(struct edge_list *));
     cg->spouses  = calloc(n_nodes, sizeof(struct edge_list *));
@@ -33,6 +34,55 @@ struct cgraph * copy_cgraph(struct cgraph *cg)
     return copy;
 }
 
+#define PARENT_LIST 0
+#define CHILD_LIST  1
+#define SPOUSE_LIST 2
+
+/* edge_hash hashes the entry node in one of the lists of a node (splitmix64) */
+static uint64_t edge_hash(int node, int list)
+{
+    uint64_t z = ((uint64_t) node << 2 | list) + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * record_change updates the hash of x after node has been inserted into
+ * (sign = 1) or removed from (sign = -1) one of the lists of x. The first
+ * change to x in an epoch adds x to the dirty set.
+ */
+static void record_change(struct cgraph_changes *c, int x, int node, int list,
+                              int sign)
+{
+    if (c->epochs[x] != c->epoch) {
+        c->epochs[x]             = c->epoch;
+        c->epoch_hash[2 * x]     = c->hash[2 * x];
+        c->epoch_hash[2 * x + 1] = c->hash[2 * x + 1];
+        c->dirty[c->n_dirty++]   = x;
+    }
+    /* children are hashed separately from parents and spouses */
+    int i = 2 * x + (list == CHILD_LIST);
+    if (sign > 0)
+        c->hash[i] += edge_hash(node, list);
+    else
+        c->hash[i] -= edge_hash(node, list);
+}
+
+static void record_edge(struct cgraph *cg, int x, int y, short edge, int sign)
+{
+    if (!cg->changes)
+        return;
+    if (IS_DIRECTED(edge)) {
+        record_change(cg->changes, x, y, CHILD_LIST, sign);
+        record_change(cg->changes, y, x, PARENT_LIST, sign);
+    }
+    else {
+        record_change(cg->changes, x, y, SPOUSE_LIST, sign);
+        record_change(cg->changes, y, x, SPOUSE_LIST, sign);
+    }
+}
+
 void add_edge_to_cgraph(struct cgraph *cg, int x, int y, short edge)
 {
     if (IS_DIRECTED(edge)) {
@@ -43,6 +93,7 @@ void add_edge_to_cgraph(struct cgraph *cg, int x, int y, short edge)
         insert_edge(&cg->spouses[x], y, edge, 0);
         insert_edge(&cg->spouses[y], x, edge, 0);
     }
+    record_edge(cg, x, y, edge, 1);
     cg->n_edges += 1;
 }
 
@@ -56,9 +107,104 @@ void delete_edge_from_cgraph(struct cgraph *cg, int x, int y, short edge)
         remove_edge(&cg->spouses[y], x);
         remove_edge(&cg->spouses[x], y);
     }
+    record_edge(cg, x, y, edge, -1);
     cg->n_edges -= 1;
 }
 
+static void free_cgraph_changes(struct cgraph_changes *c)
+{
+    free(c->hash);
+    free(c->epoch_hash);
+    free(c->epochs);
+    free(c->dirty);
+    free(c);
+}
+
+static uint64_t list_hash(struct edge_list *p, int list)
+{
+    uint64_t hash = 0;
+    while (p) {
+        hash += edge_hash(p->node, list);
+        p = p->next;
+    }
+    return hash;
+}
+
+/*
+ * track_cgraph_changes turns on change tracking for cg. From then on, every
+ * edge insertion and deletion records the nodes it changes, and
+ * get_changed_nodes reports which nodes differ from how they were at the start
+ * of the epoch. It returns 0 on success and 1 if memory could not be
+ * allocated.
+ */
+int track_cgraph_changes(struct cgraph *cg)
+{
+    int n_nodes = cg->n_nodes;
+    struct cgraph_changes *c = calloc(1, sizeof(struct cgraph_changes));
+    if (!c)
+        goto ERR;
+    c->hash       = malloc(2 * n_nodes * sizeof(uint64_t));
+    c->epoch_hash = malloc(2 * n_nodes * sizeof(uint64_t));
+    c->epochs     = calloc(n_nodes, sizeof(int));
+    c->dirty      = malloc(n_nodes * sizeof(int));
+    if (!c->hash || !c->epoch_hash || !c->epochs || !c->dirty)
+        goto ERR;
+    for (int i = 0; i < n_nodes; ++i) {
+        c->hash[2 * i]     = list_hash(cg->parents[i], PARENT_LIST)
+                             + list_hash(cg->spouses[i], SPOUSE_LIST);
+        c->hash[2 * i + 1] = list_hash(cg->children[i], CHILD_LIST);
+    }
+    c->epoch   = 1;
+    c->n_dirty = 0;
+    if (cg->changes)
+        free_cgraph_changes(cg->changes);
+    cg->changes = c;
+    return 0;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for cgraph change tracking!\n");
+    if (c)
+        free_cgraph_changes(c);
+    return 1;
+}
+
+/* new_cgraph_epoch forgets the changes made during the previous epoch */
+void new_cgraph_epoch(struct cgraph *cg)
+{
+    cg->changes->epoch  += 1;
+    cg->changes->n_dirty = 0;
+}
+
+/*
+ * get_changed_nodes stores the nodes whose adjacencies differ from the start
+ * of the current epoch in nodes, and returns how many there are. Only the
+ * nodes that were modified during the epoch are examined.
+ */
+int get_changed_nodes(struct cgraph *cg, int *nodes)
+{
+    struct cgraph_changes *c = cg->changes;
+    int n = 0;
+    for (int i = 0; i < c->n_dirty; ++i) {
+        int node = c->dirty[i];
+        if (c->hash[2 * node] != c->epoch_hash[2 * node] ||
+                c->hash[2 * node + 1] != c->epoch_hash[2 * node + 1])
+            nodes[n++] = node;
+    }
+    return n;
+}
+
+/*
+ * parents_or_spouses_changed_in_cgraph returns whether or not the parents or
+ * spouses of node differ from the start of the current epoch. Changes to the
+ * children of node are ignored.
+ */
+int parents_or_spouses_changed_in_cgraph(struct cgraph *cg, int node)
+{
+    struct cgraph_changes *c = cg->changes;
+    if (c->epochs[node] != c->epoch)
+        return 0;
+    return c->hash[2 * node] != c->epoch_hash[2 * node];
+}
+
 void free_cgraph(struct cgraph *cg)
 {
     struct edge_list **parents  = cg->parents;
@@ -72,6 +218,8 @@ void free_cgraph(struct cgraph *cg)
     free(parents);
     free(children);
     free(spouses);
+    if (cg->changes)
+        free_cgraph_changes(cg->changes);
     free(cg);
 }
 
@@ -1,15 +1,36 @@
 #ifndef CGRAPH_H_
 #define CGRAPH_H_
 
+#include <stdint.h>
+
 #include <cgraph/edge_list.h>
 
+/*
+ * cgraph_changes records which nodes have had their edges changed since the
+ * start of the current epoch. hash stores two order independent hashes for
+ * each node, one of its parents and spouses and one of its children, that are
+ * updated on every insertion and deletion. epoch_hash stores the hashes of the
+ * node when it was first changed in the current epoch. A node whose edges were changed and then changed back (which
+ * happens often when a pattern is reoriented) has the same hash it started
+ * with, so it is not reported as changed.
+ */
+struct cgraph_changes {
+    uint64_t *hash;
+    uint64_t *epoch_hash;
+    int      *epochs;
+    int      *dirty;
+    int       n_dirty;
+    int       epoch;
+};
+
 struct cgraph {
     struct edge_list **parents;
     struct edge_list **spouses;
     struct edge_list **children;
+    struct cgraph_changes *changes; /* NULL unless changes are tracked */
     int       n_nodes;
     int       n_edges;
-}; /* 32 bytes */
+}; /* 40 bytes */
 
 struct cgraph * create_cgraph(int n_nodes);
 struct cgraph * copy_cgraph(struct cgraph *cg);
@@ -23,4 +44,9 @@ int edge_undirected_in_cgraph(struct cgraph *cg, int x, int y);
 int edge_directed_in_cgraph(struct cgraph *cg, int x, int y);
 int adjacent_in_cgraph(struct cgraph *cg, int x, int y);
 int identical_in_cgraphs(struct cgraph *cg1, struct cgraph *cg2, int node);
+/* change tracking */
+int  track_cgraph_changes(struct cgraph *cg);
+void new_cgraph_epoch(struct cgraph *cg);
+int  get_changed_nodes(struct cgraph *cg, int *nodes);
+int  parents_or_spouses_changed_in_cgraph(struct cgraph *cg, int node);
 #endif
@@ -0,0 +1,311 @@
+/*
+ * adtree.c implements adtrees. A node of the tree stands for a conjunction of
+ * states (a query), and holds the number of observations that match it. For
+ * every variable after the last one in its query, the node has a vary node,
+ * whose children are the node's query extended by each state of the variable.
+ * Two things keep the tree small:
+ *
+ *  - The child for the most common state of a variable (the mcv) is never
+ *    stored, as its counts are the counts of its parent minus those of its
+ *    siblings. Neither are children that no observation matches.
+ *  - A node that matches at most leaf_threshold rows stores the rows
+ *    themselves (a leaf list) instead of its children, and queries below it
+ *    count from the rows.
+ *
+ * The tree is built until it would use more memory than its budget, in which
+ * case it is discarded, and the scores count from the rows as before.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <causality.h>
+#include <dataframe.h>
+#include <data/adtree.h>
+
+struct ad_vary;
+
+struct ad_node {
+    int             count;
+    int             start;  /* the first variable the node varies          */
+    int             n_rows;
+    int            *rows;   /* the rows of a leaf list, or NULL            */
+    struct ad_vary *vary;   /* nvar - start vary nodes, or NULL for leaves */
+};
+
+struct ad_vary {
+    int              mcv;
+    struct ad_node **children;  /* NULL for the mcv and for empty queries */
+};
+
+struct adtree {
+    struct dataframe *df;
+    struct ad_node   *root;
+    int               leaf_threshold;
+    size_t            memory;
+    size_t            budget;
+};
+
+static int weight(struct dataframe *df, int row)
+{
+    return df->weights ? df->weights[row] : 1;
+}
+
+/* charge adds size bytes to the memory used by tree, and checks the budget */
+static int charge(struct adtree *tree, size_t size)
+{
+    tree->memory += size;
+    return tree->memory > tree->budget;
+}
+
+static void free_node(struct adtree *tree, struct ad_node *node)
+{
+    if (!node)
+        return;
+    if (node->vary) {
+        for (int a = node->start; a < tree->df->nvar; ++a) {
+            struct ad_vary *vary = node->vary + a - node->start;
+            if (!vary->children)
+                continue;
+            for (int v = 0; v < tree->df->states[a]; ++v)
+                free_node(tree, vary->children[v]);
+            free(vary->children);
+        }
+        free(node->vary);
+    }
+    free(node->rows);
+    free(node);
+}
+
+/*
+ * build_node builds the node for the n_rows rows in rows, which vary by the
+ * variables from start on. rows is sorted in place. Sets err if the tree runs
+ * out of memory or exceeds its budget.
+ */
+static struct ad_node * build_node(struct adtree *tree, int *rows, int n_rows,
+                                       int start, int *err)
+{
+    struct dataframe *df     = tree->df;
+    int              *sorted = NULL;
+    struct ad_node   *node   = calloc(1, sizeof(struct ad_node));
+    if (!node || charge(tree, sizeof(struct ad_node)))
+        goto ERR;
+    node->start = start;
+    for (int i = 0; i < n_rows; ++i)
+        node->count += weight(df, rows[i]);
+    /* a node past the last variable only needs its count */
+    if (start == df->nvar)
+        return node;
+    if (n_rows <= tree->leaf_threshold) {
+        node->n_rows = n_rows;
+        node->rows   = malloc((n_rows + 1) * sizeof(int));
+        if (!node->rows || charge(tree, n_rows * sizeof(int)))
+            goto ERR;
+        memcpy(node->rows, rows, n_rows * sizeof(int));
+        return node;
+    }
+    int n_vary = df->nvar - start;
+    node->vary = calloc(n_vary, sizeof(struct ad_vary));
+    sorted     = malloc(n_rows * sizeof(int));
+    if (!node->vary || !sorted || charge(tree, n_vary * sizeof(struct ad_vary)))
+        goto ERR;
+    for (int a = start; a < df->nvar; ++a) {
+        struct ad_vary *vary     = node->vary + a - start;
+        int            *col      = df->df[a];
+        int             n_states = df->states[a];
+        int             offsets[n_states + 1];
+        vary->children = calloc(n_states, sizeof(struct ad_node *));
+        if (!vary->children ||
+                charge(tree, n_states * sizeof(struct ad_node *)))
+            goto ERR;
+        /* counting sort the rows by their state of a */
+        memset(offsets, 0, (n_states + 1) * sizeof(int));
+        for (int i = 0; i < n_rows; ++i)
+            offsets[col[rows[i]] + 1]++;
+        vary->mcv = 0;
+        for (int v = 0; v < n_states; ++v) {
+            if (offsets[v + 1] > offsets[vary->mcv + 1])
+                vary->mcv = v;
+        }
+        for (int v = 0; v < n_states; ++v)
+            offsets[v + 1] += offsets[v];
+        int next[n_states];
+        memcpy(next, offsets, n_states * sizeof(int));
+        for (int i = 0; i < n_rows; ++i)
+            sorted[next[col[rows[i]]]++] = rows[i];
+        /* the children sort their own copies, so sorted can be reused */
+        for (int v = 0; v < n_states; ++v) {
+            int n = offsets[v + 1] - offsets[v];
+            if (v == vary->mcv || n == 0)
+                continue;
+            vary->children[v] = build_node(tree, sorted + offsets[v], n, a + 1,
+                                               err);
+            if (*err)
+                goto ERR;
+        }
+    }
+    free(sorted);
+    return node;
+    ERR:
+    *err = 1;
+    free(sorted);
+    free_node(tree, node);
+    return NULL;
+}
+
+/*
+ * create_adtree builds the adtree of df, whose variables must all be discrete,
+ * and which must outlive the tree. budget is the most memory, in bytes, the
+ * tree may use; if it needs more, NULL is returned. Nodes that match at most
+ * leaf_threshold rows keep their rows instead of their children.
+ */
+struct adtree * create_adtree(struct dataframe *df, size_t budget,
+                                  int leaf_threshold)
+{
+    for (int i = 0; i < df->nvar; ++i) {
+        if (!df->states[i]) {
+            CAUSALITY_ERROR("An adtree can only count discrete data.\n");
+            return NULL;
+        }
+    }
+    struct adtree *tree = calloc(1, sizeof(struct adtree));
+    int           *rows = malloc((df->nobs + 1) * sizeof(int));
+    if (!tree || !rows) {
+        CAUSALITY_ERROR("Failed to allocate memory for the adtree.\n");
+        free(tree);
+        free(rows);
+        return NULL;
+    }
+    tree->df             = df;
+    tree->budget         = budget;
+    tree->leaf_threshold = leaf_threshold;
+    for (int i = 0; i < df->nobs; ++i)
+        rows[i] = i;
+    int err    = 0;
+    tree->root = build_node(tree, rows, df->nobs, 0, &err);
+    free(rows);
+    if (err) {
+        CAUSALITY_ERROR("The adtree does not fit in its memory budget; "
+                        "counting from the data instead.\n");
+        free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+void free_adtree(struct adtree *tree)
+{
+    free_node(tree, tree->root);
+    free(tree);
+}
+
+size_t adtree_memory(struct adtree *tree)
+{
+    return tree->memory;
+}
+
+/*
+ * fill_table writes the counts of the states of the k variables in attrs,
+ * which are sorted, among the observations that match node into table, with
+ * attrs[0] the most significant. This is the contingency table algorithm of
+ * Moore and Lee: the table for the mcv of attrs[0] is the table of node
+ * itself, less the tables of the other states.
+ */
+static void fill_table(struct adtree *tree, struct ad_node *node, int *attrs,
+                           int k, int *table)
+{
+    struct dataframe *df = tree->df;
+    int size = 1;
+    for (int i = 0; i < k; ++i)
+        size *= df->states[attrs[i]];
+    if (!node) {
+        memset(table, 0, size * sizeof(int));
+        return;
+    }
+    if (k == 0) {
+        table[0] = node->count;
+        return;
+    }
+    if (node->rows) {
+        memset(table, 0, size * sizeof(int));
+        for (int i = 0; i < node->n_rows; ++i) {
+            int row = node->rows[i];
+            int j   = 0;
+            for (int c = 0; c < k; ++c)
+                j = j * df->states[attrs[c]] + ((int *) df->df[attrs[c]])[row];
+            table[j] += weight(df, row);
+        }
+        return;
+    }
+    int             a    = attrs[0];
+    struct ad_vary *vary = node->vary + a - node->start;
+    int             sub  = size / df->states[a];
+    int            *mcv  = table + vary->mcv * sub;
+    fill_table(tree, node, attrs + 1, k - 1, mcv);
+    for (int v = 0; v < df->states[a]; ++v) {
+        if (v == vary->mcv)
+            continue;
+        int *block = table + v * sub;
+        fill_table(tree, vary->children[v], attrs + 1, k - 1, block);
+        if (!vary->children[v])
+            continue;
+        for (int j = 0; j < sub; ++j)
+            mcv[j] -= block[j];
+    }
+}
+
+/*
+ * adtree_counts writes the contingency table of y = xy[n - 1] and its parents
+ * xy[0], ..., xy[n - 2] into n_jk, in the layout the discrete scores use: row
+ * j holds the counts of y when the parents are in (mixed radix) state j, with
+ * xy[0] the most significant. The row sums are written into n_j. Returns
+ * nonzero on failure.
+ */
+int adtree_counts(struct adtree *tree, int *xy, int n, int *n_jk, int *n_j)
+{
+    struct dataframe *df = tree->df;
+    /* the tree answers queries with sorted variables */
+    int attrs[n];
+    int pos[n];
+    int size   = 1;
+    int sorted = 1;
+    for (int i = 0; i < n; ++i) {
+        int j = i;
+        for (; j > 0 && attrs[j - 1] > xy[i]; --j) {
+            attrs[j] = attrs[j - 1];
+            pos[j]   = pos[j - 1];
+        }
+        attrs[j] = xy[i];
+        pos[j]   = i;
+        size    *= df->states[xy[i]];
+        sorted  &= j == i;
+    }
+    int *table = n_jk;
+    if (!sorted && !(table = malloc(size * sizeof(int))))
+        return -1;
+    fill_table(tree, tree->root, attrs, n, table);
+    if (!sorted) {
+        int stride[n];
+        stride[n - 1] = 1;
+        for (int i = n - 1; i > 0; --i)
+            stride[i - 1] = stride[i] * df->states[xy[i]];
+        for (int c = 0; c < size; ++c) {
+            int rem = c;
+            int j   = 0;
+            for (int i = n - 1; i >= 0; --i) {
+                int n_states = df->states[attrs[i]];
+                j   += rem % n_states * stride[pos[i]];
+                rem /= n_states;
+            }
+            n_jk[j] = table[c];
+        }
+        free(table);
+    }
+    int n_y_states = df->states[xy[n - 1]];
+    for (int j = 0; j < size / n_y_states; ++j) {
+        n_j[j] = 0;
+        for (int k = 0; k < n_y_states; ++k)
+            n_j[j] += n_jk[j * n_y_states + k];
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef ADTREE_H
+#define ADTREE_H
+
+#include <stddef.h>
+
+#include <dataframe.h>
+
+#define ADTREE_LEAF_THRESHOLD 16
+
+/*
+ * An adtree (all dimensions tree) caches the counts of every conjunction of
+ * states of the discrete variables of a dataframe, so contingency tables can
+ * be built from it without reading the rows of the dataframe. See
+ *
+ * Moore A, Lee MS. Cached sufficient statistics for efficient machine
+ * learning with large datasets. Journal of Artificial Intelligence Research.
+ * 1998;8:67-91.
+ */
+struct adtree;
+
+struct adtree * create_adtree(struct dataframe *df, size_t budget,
+                                  int leaf_threshold);
+void free_adtree(struct adtree *tree);
+size_t adtree_memory(struct adtree *tree);
+int  adtree_counts(struct adtree *tree, int *xy, int n, int *n_jk, int *n_j);
+#endif
@@ -0,0 +1,385 @@
+/*
+ * data_file.c implements causality data files, a column major binary format
+ * for datasets (see data_file.h). Instead of copying every column into
+ * memory, like prepare_dataframe does, map_data_file memory maps the file and
+ * points the columns of the dataframe directly into the mapping, so only the
+ * pages that are being read need to be in memory. stream_covariance_matrix
+ * calculates the covariance matrix one block of rows at a time, so each page
+ * is read once, and the BIC scores never touch the columns again. A file can
+ * also be written a block of rows at a time, with create_data_file and
+ * write_data_rows, for datasets that do not fit in memory either.
+ */
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#define _POSIX_C_SOURCE 200112L
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <causality.h>
+#include <dataframe.h>
+#include <scores/linearalgebra.h>
+#include <data/data_file.h>
+
+#define MAGIC_SIZE  8
+#define HEADER_SIZE (MAGIC_SIZE + 2 * sizeof(int32_t) + sizeof(int64_t))
+
+/* the dataframe must be the first member so the file can be found from it */
+struct data_file {
+    struct dataframe df;
+    char            *map;
+    size_t           size;
+    const char     **names;
+};
+
+static size_t align_size(size_t size)
+{
+    return (size + DATA_FILE_ALIGNMENT - 1) / DATA_FILE_ALIGNMENT *
+               DATA_FILE_ALIGNMENT;
+}
+
+static size_t column_size(struct dataframe *df, int i)
+{
+    size_t size = df->states[i] ? sizeof(int32_t) : sizeof(double);
+    return align_size(size * df->nobs);
+}
+
+/*
+ * write_header writes the header of a data file for the variables of df,
+ * called names, to fp, padded to the alignment of the columns, and stores its
+ * size in header_size. Returns nonzero on failure.
+ */
+static int write_header(FILE *fp, struct dataframe *df, const char **names,
+                            int64_t *header_size)
+{
+    static const char padding[DATA_FILE_ALIGNMENT];
+    int32_t nvar = df->nvar;
+    int32_t nobs = df->nobs;
+    size_t  size = HEADER_SIZE + nvar * sizeof(int32_t);
+    for (int i = 0; i < nvar; ++i)
+        size += strlen(names[i]) + 1;
+    *header_size = align_size(size);
+    int err = 0;
+    err |= fwrite(DATA_FILE_MAGIC, 1, MAGIC_SIZE, fp) != MAGIC_SIZE;
+    err |= fwrite(&nvar, sizeof(int32_t), 1, fp) != 1;
+    err |= fwrite(&nobs, sizeof(int32_t), 1, fp) != 1;
+    err |= fwrite(header_size, sizeof(int64_t), 1, fp) != 1;
+    for (int i = 0; i < nvar; ++i) {
+        int32_t states = df->states[i];
+        err |= fwrite(&states, sizeof(int32_t), 1, fp) != 1;
+    }
+    for (int i = 0; i < nvar; ++i) {
+        size_t len = strlen(names[i]) + 1;
+        err |= fwrite(names[i], 1, len, fp) != len;
+    }
+    size_t pad = *header_size - size;
+    err |= fwrite(padding, 1, pad, fp) != pad;
+    return err;
+}
+
+/* seek_file moves fp to offset, which may be past 2GB */
+static int seek_file(FILE *fp, int64_t offset)
+{
+    #ifdef _WIN32
+    return _fseeki64(fp, offset, SEEK_SET);
+    #else
+    return fseeko(fp, offset, SEEK_SET);
+    #endif
+}
+
+/*
+ * write_data_file writes the dataframe df, whose variables are called names,
+ * to a causality data file at path. The continuous columns of df should
+ * already be normalized, as they are by prepare_dataframe. Returns nonzero on
+ * failure.
+ */
+int write_data_file(const char *path, struct dataframe *df,
+                        const char **names)
+{
+    static const char padding[DATA_FILE_ALIGNMENT];
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        CAUSALITY_ERROR("Failed to open %s for writing.\n", path);
+        return 1;
+    }
+    int64_t header_size;
+    int err = write_header(fp, df, names, &header_size);
+    for (int i = 0; i < df->nvar && !err; ++i) {
+        size_t elem = df->states[i] ? sizeof(int32_t) : sizeof(double);
+        size_t len  = elem * df->nobs;
+        err |= fwrite(df->df[i], 1, len, fp) != len;
+        len  = column_size(df, i) - len;
+        err |= fwrite(padding, 1, len, fp) != len;
+    }
+    err |= fclose(fp) != 0;
+    if (err)
+        CAUSALITY_ERROR("Failed to write %s.\n", path);
+    return err;
+}
+
+/*
+ * create_data_file writes the header of a causality data file at path for the
+ * df->nobs rows of the variables of df, called names, and sizes the file for
+ * their columns, which are left empty: the columns of df are not read. The
+ * rows are then written a block at a time by write_data_rows, so a dataset
+ * never has to be in memory all at once. Returns nonzero on failure.
+ */
+int create_data_file(const char *path, struct dataframe *df,
+                         const char **names)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        CAUSALITY_ERROR("Failed to open %s for writing.\n", path);
+        return 1;
+    }
+    int64_t size;
+    int err = write_header(fp, df, names, &size);
+    for (int i = 0; i < df->nvar; ++i)
+        size += column_size(df, i);
+    /* writing the last byte extends the file, without writing the columns */
+    if (!err && size > ftell(fp)) {
+        err |= seek_file(fp, size - 1) != 0;
+        err |= fputc(0, fp) == EOF;
+    }
+    err |= fclose(fp) != 0;
+    if (err)
+        CAUSALITY_ERROR("Failed to write %s.\n", path);
+    return err;
+}
+
+/*
+ * write_data_rows writes the rows of df into rows start, ..., start +
+ * df->nobs - 1 of the causality data file at path, which was created by
+ * create_data_file. df must have the same variables as the file, and its
+ * continuous columns should already be normalized (over every row of the
+ * file, not just the rows of df). Returns nonzero on failure.
+ */
+int write_data_rows(const char *path, struct dataframe *df, int start)
+{
+    FILE *fp = fopen(path, "r+b");
+    if (!fp) {
+        CAUSALITY_ERROR("Failed to open %s for writing.\n", path);
+        return 1;
+    }
+    char    magic[MAGIC_SIZE];
+    int32_t nvar = 0, nobs = 0;
+    int64_t header_size = 0;
+    int32_t *states = NULL;
+    int err = 0;
+    err |= fread(magic, 1, MAGIC_SIZE, fp) != MAGIC_SIZE;
+    err |= fread(&nvar, sizeof(int32_t), 1, fp) != 1;
+    err |= fread(&nobs, sizeof(int32_t), 1, fp) != 1;
+    err |= fread(&header_size, sizeof(int64_t), 1, fp) != 1;
+    if (err || memcmp(magic, DATA_FILE_MAGIC, MAGIC_SIZE) ||
+            nvar != df->nvar || start < 0 || start + df->nobs > nobs)
+        goto ERR;
+    states = malloc(nvar * sizeof(int32_t));
+    if (!states || fread(states, sizeof(int32_t), nvar, fp) != (size_t) nvar)
+        goto ERR;
+    for (int i = 0; i < nvar; ++i) {
+        if (states[i] != df->states[i])
+            goto ERR;
+    }
+    /* the columns of the file are laid out for all of its rows */
+    struct dataframe file = {.nvar = nvar, .nobs = nobs, .states = df->states};
+    int64_t offset = header_size;
+    for (int i = 0; i < nvar && !err; ++i) {
+        size_t elem = df->states[i] ? sizeof(int32_t) : sizeof(double);
+        size_t len  = elem * df->nobs;
+        err |= seek_file(fp, offset + (int64_t) elem * start) != 0;
+        err |= fwrite(df->df[i], 1, len, fp) != len;
+        offset += column_size(&file, i);
+    }
+    free(states);
+    err |= fclose(fp) != 0;
+    if (err)
+        CAUSALITY_ERROR("Failed to write %s.\n", path);
+    return err;
+    ERR:
+    CAUSALITY_ERROR("The rows do not fit the data file %s.\n", path);
+    free(states);
+    fclose(fp);
+    return 1;
+}
+
+/*
+ * map_file maps the file at path into memory, and stores its size in size.
+ * Systems without mmap read the file into memory instead.
+ */
+static char * map_file(const char *path, size_t *size)
+{
+    #ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    /* keep the columns aligned, like they are in a mapping */
+    char *map = _aligned_malloc(*size + 1, DATA_FILE_ALIGNMENT);
+    if (map && fread(map, 1, *size, fp) != *size) {
+        _aligned_free(map);
+        map = NULL;
+    }
+    fclose(fp);
+    return map;
+    #else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    *size = st.st_size;
+    void *map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    /* the columns are read front to back */
+    posix_madvise(map, *size, POSIX_MADV_SEQUENTIAL);
+    return map;
+    #endif
+}
+
+static void unmap_file(char *map, size_t size)
+{
+    #ifdef _WIN32
+    _aligned_free(map);
+    #else
+    munmap(map, size);
+    #endif
+}
+
+/*
+ * map_data_file opens the causality data file at path as a dataframe whose
+ * columns point into the file. The dataframe must be freed with
+ * unmap_data_file. Returns NULL on failure.
+ */
+struct dataframe * map_data_file(const char *path)
+{
+    struct data_file *file = calloc(1, sizeof(struct data_file));
+    if (!file) {
+        CAUSALITY_ERROR("Failed to allocate memory for data file.\n");
+        return NULL;
+    }
+    file->map = map_file(path, &file->size);
+    if (!file->map) {
+        CAUSALITY_ERROR("Failed to open %s.\n", path);
+        free(file);
+        return NULL;
+    }
+    struct dataframe *df = &file->df;
+    char   *map = file->map;
+    int32_t nvar, nobs;
+    int64_t header_size;
+    if (file->size < HEADER_SIZE || memcmp(map, DATA_FILE_MAGIC, MAGIC_SIZE))
+        goto ERR;
+    memcpy(&nvar, map + MAGIC_SIZE, sizeof(int32_t));
+    memcpy(&nobs, map + MAGIC_SIZE + sizeof(int32_t), sizeof(int32_t));
+    memcpy(&header_size, map + MAGIC_SIZE + 2 * sizeof(int32_t),
+               sizeof(int64_t));
+    if (nvar < 1 || nobs < 1 || header_size % DATA_FILE_ALIGNMENT ||
+            (size_t) header_size > file->size ||
+            HEADER_SIZE + nvar * sizeof(int32_t) > (size_t) header_size)
+        goto ERR;
+    df->nvar   = nvar;
+    df->nobs   = nobs;
+    df->states = (int *) (map + HEADER_SIZE);
+    df->df     = calloc(nvar, sizeof(void *));
+    file->names = calloc(nvar, sizeof(char *));
+    if (!df->df || !file->names)
+        goto ERR;
+    /* the names are NUL terminated strings at the end of the header */
+    char *name = map + HEADER_SIZE + nvar * sizeof(int32_t);
+    for (int i = 0; i < nvar; ++i) {
+        char *end = memchr(name, '\0', map + header_size - name);
+        if (!end)
+            goto ERR;
+        file->names[i] = name;
+        name = end + 1;
+    }
+    size_t offset = header_size;
+    for (int i = 0; i < nvar; ++i) {
+        if (df->states[i] < 0 || offset + column_size(df, i) > file->size)
+            goto ERR;
+        df->df[i] = map + offset;
+        offset   += column_size(df, i);
+    }
+    return df;
+    ERR:
+    CAUSALITY_ERROR("%s is not a valid causality data file.\n", path);
+    unmap_data_file(df);
+    return NULL;
+}
+
+/* data_file_name returns the name of the ith variable of a mapped dataframe */
+const char * data_file_name(struct dataframe *df, int i)
+{
+    return ((struct data_file *) df)->names[i];
+}
+
+void unmap_data_file(struct dataframe *df)
+{
+    struct data_file *file = (struct data_file *) df;
+    unmap_file(file->map, file->size);
+    free(file->names);
+    free(df->df);
+    free(df->cov);
+    free(file);
+}
+
+/*
+ * stream_covariance_matrix calculates the covariance matrix of df, which must
+ * be continuous, in blocks of DATA_FILE_BLOCK rows: every column is read
+ * block by block, instead of once per pair of variables, so data that does
+ * not fit in memory is only read from disk once. The rows of the matrix are
+ * accumulated in parallel using nthreads threads. Returns nonzero on failure.
+ */
+int stream_covariance_matrix(struct dataframe *df, int nthreads)
+{
+    int nvar = df->nvar;
+    int nobs = df->nobs;
+    if (df->cov)
+        return 0;
+    for (int i = 0; i < nvar; ++i) {
+        if (df->states[i]) {
+            CAUSALITY_ERROR("Covariances require continuous variables.\n");
+            return 1;
+        }
+    }
+    double *cov = calloc((size_t) nvar * nvar, sizeof(double));
+    if (!cov) {
+        CAUSALITY_ERROR("Failed to allocate memory for covariance matrix.\n");
+        return 1;
+    }
+    double **x = (double **) df->df;
+    for (int start = 0; start < nobs; start += DATA_FILE_BLOCK) {
+        int end = start + DATA_FILE_BLOCK < nobs ? start + DATA_FILE_BLOCK :
+                                                   nobs;
+        #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+        for (int i = 0; i < nvar; ++i)
+            calc_cross_products_block(cov + (size_t) i * nvar, x, i, nvar,
+                                          start, end);
+    }
+    double inv_nm1 = 1.0f / (nobs - 1.0f);
+    for (int i = 0; i < nvar; ++i) {
+        cov[(size_t) i * nvar + i] = 1.0f;
+        for (int j = i + 1; j < nvar; ++j) {
+            cov[(size_t) i * nvar + j] *= inv_nm1;
+            cov[(size_t) j * nvar + i]  = cov[(size_t) i * nvar + j];
+        }
+    }
+    df->cov = cov;
+    return 0;
+}
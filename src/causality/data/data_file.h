@@ -0,0 +1,34 @@
+#ifndef DATA_FILE_H
+#define DATA_FILE_H
+
+#include <dataframe.h>
+
+/*
+ * A causality data file stores a dataframe column by column so it can be
+ * memory mapped instead of read into memory. The layout (native byte order)
+ * is:
+ *
+ *     char    magic[8]       "CCFDATA1"
+ *     int32   nvar
+ *     int32   nobs
+ *     int64   header_size    offset of the first column, a multiple of 64
+ *     int32   states[nvar]   0 for continuous variables
+ *     char    names[]        nvar NUL terminated variable names
+ *
+ * followed by the columns, each starting on a 64 byte boundary: nobs doubles
+ * (normalized) for continuous variables, or nobs int32s for discrete ones.
+ */
+#define DATA_FILE_MAGIC     "CCFDATA1"
+#define DATA_FILE_ALIGNMENT 64
+#define DATA_FILE_BLOCK     4096 /* rows per block when streaming columns */
+
+int write_data_file(const char *path, struct dataframe *df,
+                        const char **names);
+int create_data_file(const char *path, struct dataframe *df,
+                         const char **names);
+int write_data_rows(const char *path, struct dataframe *df, int start);
+struct dataframe * map_data_file(const char *path);
+const char * data_file_name(struct dataframe *df, int i);
+void unmap_data_file(struct dataframe *df);
+int  stream_covariance_matrix(struct dataframe *df, int nthreads);
+#endif
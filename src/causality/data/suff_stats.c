@@ -0,0 +1,460 @@
+/*
+ * suff_stats.c implements mergeable sufficient statistics. Continuous chunks
+ * are summarized by their means and comoments, which are merged with the
+ * pairwise update of Chan et al.:
+ *
+ *     M = M_a + M_b + (mean_b - mean_a)(mean_b - mean_a)^T n_a n_b / n,
+ *
+ * so no chunk ever needs to be revisited and merging costs O(nvar^2).
+ * Discrete chunks are summarized by the counts of their distinct rows, which
+ * are merged by adding the counts. Either can be turned back into a
+ * dataframe that the scores can use directly: a covariance matrix for the
+ * continuous scores, or the distinct rows weighted by their counts for the
+ * discrete ones.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <causality.h>
+#include <dataframe.h>
+#include <scores/linearalgebra.h>
+#include <data/suff_stats.h>
+
+#define MAGIC_SIZE       8
+#define INITIAL_CAPACITY 64
+
+static int is_continuous(struct suff_stats *ss)
+{
+    return ss->states[0] == 0;
+}
+
+struct suff_stats * create_suff_stats(int nvar, int *states)
+{
+    for (int i = 1; i < nvar; ++i) {
+        if (!states[i] != !states[0]) {
+            CAUSALITY_ERROR("Sufficient statistics cannot mix continuous and "
+                            "discrete variables.\n");
+            return NULL;
+        }
+    }
+    struct suff_stats *ss = calloc(1, sizeof(struct suff_stats));
+    if (!ss)
+        goto ERR;
+    ss->nvar   = nvar;
+    ss->states = malloc(nvar * sizeof(int));
+    if (!ss->states)
+        goto ERR;
+    memcpy(ss->states, states, nvar * sizeof(int));
+    if (is_continuous(ss)) {
+        ss->mean      = calloc(nvar, sizeof(double));
+        ss->comoments = calloc((size_t) nvar * nvar, sizeof(double));
+        if (!ss->mean || !ss->comoments)
+            goto ERR;
+    }
+    else {
+        ss->capacity = INITIAL_CAPACITY;
+        ss->rows     = malloc((size_t) ss->capacity * nvar * sizeof(int));
+        ss->counts   = calloc(ss->capacity, sizeof(int));
+        if (!ss->rows || !ss->counts)
+            goto ERR;
+    }
+    return ss;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for sufficient statistics.\n");
+    if (ss)
+        free_suff_stats(ss);
+    return NULL;
+}
+
+void free_suff_stats(struct suff_stats *ss)
+{
+    free(ss->states);
+    free(ss->mean);
+    free(ss->comoments);
+    free(ss->rows);
+    free(ss->counts);
+    free(ss);
+}
+
+/*
+ * merge_moments merges the means and comoments of n_b observations into the
+ * statistics in ss.
+ */
+static void merge_moments(struct suff_stats *ss, double *mean_b,
+                              double *comoments_b, int n_b)
+{
+    int    nvar  = ss->nvar;
+    double n_a   = ss->nobs;
+    double n     = n_a + n_b;
+    double scale = n_a * n_b / n;
+    double delta[nvar];
+    for (int i = 0; i < nvar; ++i)
+        delta[i] = mean_b[i] - ss->mean[i];
+    for (int i = 0; i < nvar; ++i) {
+        double *m_i = ss->comoments + (size_t) i * nvar;
+        double *b_i = comoments_b + (size_t) i * nvar;
+        for (int j = i; j < nvar; ++j)
+            m_i[j] += b_i[j] + delta[i] * delta[j] * scale;
+        ss->mean[i] += delta[i] * n_b / n;
+    }
+    ss->nobs += n_b;
+}
+
+static uint64_t hash_row(int *row, int nvar)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < nvar; ++i) {
+        h ^= (uint32_t) row[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* find_slot returns the slot of row in the hash table, or an empty slot */
+static int find_slot(struct suff_stats *ss, int *row)
+{
+    int mask = ss->capacity - 1;
+    int slot = hash_row(row, ss->nvar) & mask;
+    while (ss->counts[slot]) {
+        int *key = ss->rows + (size_t) slot * ss->nvar;
+        if (!memcmp(key, row, ss->nvar * sizeof(int)))
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int grow_table(struct suff_stats *ss)
+{
+    int  nvar     = ss->nvar;
+    int  capacity = ss->capacity;
+    int *rows     = ss->rows;
+    int *counts   = ss->counts;
+    ss->capacity *= 2;
+    ss->rows      = malloc((size_t) ss->capacity * nvar * sizeof(int));
+    ss->counts    = calloc(ss->capacity, sizeof(int));
+    if (!ss->rows || !ss->counts) {
+        free(ss->rows);
+        free(ss->counts);
+        ss->rows     = rows;
+        ss->counts   = counts;
+        ss->capacity = capacity;
+        return 1;
+    }
+    for (int i = 0; i < capacity; ++i) {
+        if (!counts[i])
+            continue;
+        int *row  = rows + (size_t) i * nvar;
+        int  slot = find_slot(ss, row);
+        memcpy(ss->rows + (size_t) slot * nvar, row, nvar * sizeof(int));
+        ss->counts[slot] = counts[i];
+    }
+    free(rows);
+    free(counts);
+    return 0;
+}
+
+/* reserve_rows grows the contingency table until it has room for n_rows rows */
+static int reserve_rows(struct suff_stats *ss, int n_rows)
+{
+    while (2 * (n_rows + 1) > ss->capacity) {
+        if (grow_table(ss)) {
+            CAUSALITY_ERROR("Failed to allocate memory for contingency "
+                            "table.\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* add_row adds count observations of row to the contingency table */
+static int add_row(struct suff_stats *ss, int *row, int count)
+{
+    if (reserve_rows(ss, ss->n_rows + 1))
+        return 1;
+    int slot = find_slot(ss, row);
+    if (!ss->counts[slot]) {
+        memcpy(ss->rows + (size_t) slot * ss->nvar, row,
+                   ss->nvar * sizeof(int));
+        ss->n_rows++;
+    }
+    ss->counts[slot] += count;
+    return 0;
+}
+
+/*
+ * accumulate_suff_stats adds the observations in chunk, a dataframe of raw
+ * (not normalized) data with the same variables as ss, to ss. Returns nonzero
+ * on failure.
+ */
+int accumulate_suff_stats(struct suff_stats *ss, struct dataframe *chunk)
+{
+    int nvar = ss->nvar;
+    int n    = chunk->nobs;
+    int match = chunk->nvar == nvar;
+    for (int i = 0; i < nvar && match; ++i)
+        match = chunk->states[i] == ss->states[i];
+    if (!match) {
+        CAUSALITY_ERROR("Chunk does not match the sufficient statistics.\n");
+        return 1;
+    }
+    if (n == 0)
+        return 0;
+    if (!is_continuous(ss)) {
+        int row[nvar];
+        for (int k = 0; k < n; ++k) {
+            for (int i = 0; i < nvar; ++i) {
+                row[i] = ((int *) chunk->df[i])[k];
+                if (row[i] < 0 || row[i] >= ss->states[i]) {
+                    CAUSALITY_ERROR("Chunk contains an unknown state.\n");
+                    return 1;
+                }
+            }
+            if (add_row(ss, row, 1))
+                return 1;
+        }
+        ss->nobs += n;
+        return 0;
+    }
+    /* center the chunk, then calculate its comoments */
+    size_t   size = (size_t) nvar * (n + nvar + 1);
+    double  *mem  = malloc(size * sizeof(double));
+    double **x    = malloc(nvar * sizeof(double *));
+    if (!mem || !x) {
+        CAUSALITY_ERROR("Failed to allocate memory for sufficient "
+                        "statistics.\n");
+        free(mem);
+        free(x);
+        return 1;
+    }
+    double *mean      = mem;
+    double *comoments = mem + nvar;
+    for (int i = 0; i < nvar; ++i) {
+        double *col = chunk->df[i];
+        x[i]        = mem + nvar * (nvar + 1) + (size_t) i * n;
+        mean[i]     = 0.0f;
+        for (int k = 0; k < n; ++k)
+            mean[i] += col[k];
+        mean[i] /= n;
+        for (int k = 0; k < n; ++k)
+            x[i][k] = col[k] - mean[i];
+    }
+    memset(comoments, 0, (size_t) nvar * nvar * sizeof(double));
+    for (int i = 0; i < nvar; ++i)
+        calc_cross_products_block(comoments + (size_t) i * nvar, x, i, nvar,
+                                      0, n);
+    merge_moments(ss, mean, comoments, n);
+    free(mem);
+    free(x);
+    return 0;
+}
+
+/*
+ * merge_suff_stats adds the statistics in b to a. Both must be over the same
+ * variables. Returns nonzero on failure.
+ */
+int merge_suff_stats(struct suff_stats *a, struct suff_stats *b)
+{
+    if (a->nvar != b->nvar ||
+            memcmp(a->states, b->states, a->nvar * sizeof(int))) {
+        CAUSALITY_ERROR("Cannot merge sufficient statistics of different "
+                        "variables.\n");
+        return 1;
+    }
+    if (b->nobs == 0)
+        return 0;
+    if (is_continuous(a)) {
+        merge_moments(a, b->mean, b->comoments, b->nobs);
+        return 0;
+    }
+    /*
+     * make room for every row of b first, so that adding them never grows a,
+     * which would free the table being walked if a and b are the same
+     */
+    if (reserve_rows(a, a->n_rows + b->n_rows))
+        return 1;
+    for (int i = 0; i < b->capacity; ++i) {
+        if (b->counts[i] &&
+                add_row(a, b->rows + (size_t) i * b->nvar, b->counts[i]))
+            return 1;
+    }
+    a->nobs += b->nobs;
+    return 0;
+}
+
+/*
+ * write_suff_stats writes ss to path (in native byte order), so statistics
+ * calculated by different processes can be merged. Returns nonzero on
+ * failure.
+ */
+int write_suff_stats(struct suff_stats *ss, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        CAUSALITY_ERROR("Failed to open %s for writing.\n", path);
+        return 1;
+    }
+    int nvar = ss->nvar;
+    int err  = 0;
+    err |= fwrite(SUFF_STATS_MAGIC, 1, MAGIC_SIZE, fp) != MAGIC_SIZE;
+    err |= fwrite(&ss->nvar, sizeof(int), 1, fp) != 1;
+    err |= fwrite(&ss->nobs, sizeof(int), 1, fp) != 1;
+    err |= fwrite(ss->states, sizeof(int), nvar, fp) != (size_t) nvar;
+    if (is_continuous(ss)) {
+        size_t size = (size_t) nvar * nvar;
+        err |= fwrite(ss->mean, sizeof(double), nvar, fp) != (size_t) nvar;
+        err |= fwrite(ss->comoments, sizeof(double), size, fp) != size;
+    }
+    else {
+        err |= fwrite(&ss->n_rows, sizeof(int), 1, fp) != 1;
+        for (int i = 0; i < ss->capacity && !err; ++i) {
+            if (!ss->counts[i])
+                continue;
+            int *row = ss->rows + (size_t) i * nvar;
+            err |= fwrite(row, sizeof(int), nvar, fp) != (size_t) nvar;
+            err |= fwrite(ss->counts + i, sizeof(int), 1, fp) != 1;
+        }
+    }
+    err |= fclose(fp) != 0;
+    if (err)
+        CAUSALITY_ERROR("Failed to write %s.\n", path);
+    return err;
+}
+
+/* read_suff_stats reads statistics written by write_suff_stats */
+struct suff_stats * read_suff_stats(const char *path)
+{
+    struct suff_stats *ss = NULL;
+    int *states = NULL;
+    int  nvar, nobs, n_rows;
+    char magic[MAGIC_SIZE];
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        CAUSALITY_ERROR("Failed to open %s.\n", path);
+        return NULL;
+    }
+    if (fread(magic, 1, MAGIC_SIZE, fp) != MAGIC_SIZE ||
+            memcmp(magic, SUFF_STATS_MAGIC, MAGIC_SIZE) ||
+            fread(&nvar, sizeof(int), 1, fp) != 1 || nvar < 1 ||
+            fread(&nobs, sizeof(int), 1, fp) != 1 || nobs < 0)
+        goto ERR;
+    states = malloc(nvar * sizeof(int));
+    if (!states || fread(states, sizeof(int), nvar, fp) != (size_t) nvar)
+        goto ERR;
+    ss = create_suff_stats(nvar, states);
+    if (!ss)
+        goto ERR;
+    if (is_continuous(ss)) {
+        size_t size = (size_t) nvar * nvar;
+        if (fread(ss->mean, sizeof(double), nvar, fp) != (size_t) nvar ||
+                fread(ss->comoments, sizeof(double), size, fp) != size)
+            goto ERR;
+        ss->nobs = nobs;
+    }
+    else {
+        int row[nvar + 1];
+        if (fread(&n_rows, sizeof(int), 1, fp) != 1)
+            goto ERR;
+        for (int i = 0; i < n_rows; ++i) {
+            if (fread(row, sizeof(int), nvar + 1, fp) != (size_t) nvar + 1)
+                goto ERR;
+            /* the scores index their tables by the states of each row */
+            for (int j = 0; j < nvar; ++j) {
+                if (row[j] < 0 || row[j] >= states[j])
+                    goto ERR;
+            }
+            if (row[nvar] <= 0 || add_row(ss, row, row[nvar]))
+                goto ERR;
+        }
+        ss->nobs = nobs;
+    }
+    free(states);
+    fclose(fp);
+    return ss;
+    ERR:
+    CAUSALITY_ERROR("%s is not a valid sufficient statistics file.\n", path);
+    free(states);
+    if (ss)
+        free_suff_stats(ss);
+    fclose(fp);
+    return NULL;
+}
+
+/*
+ * suff_stats_dataframe creates a dataframe from ss that the scores can use in
+ * place of the data: the correlation matrix and number of observations of
+ * continuous data, or the distinct rows of discrete data, weighted by their
+ * counts. The dataframe shares its states with ss, and must be freed with
+ * free_suff_stats_dataframe. Returns NULL on failure.
+ */
+struct dataframe * suff_stats_dataframe(struct suff_stats *ss)
+{
+    int nvar = ss->nvar;
+    struct dataframe *df = calloc(1, sizeof(struct dataframe));
+    if (!df)
+        goto ERR;
+    df->nvar   = nvar;
+    df->states = ss->states;
+    if (is_continuous(ss)) {
+        if (ss->nobs < 2) {
+            CAUSALITY_ERROR("At least 2 observations are needed.\n");
+            free(df);
+            return NULL;
+        }
+        df->nobs = ss->nobs;
+        df->cov  = malloc((size_t) nvar * nvar * sizeof(double));
+        if (!df->cov)
+            goto ERR;
+        for (int i = 0; i < nvar; ++i) {
+            double *m_i = ss->comoments + (size_t) i * nvar;
+            for (int j = i; j < nvar; ++j) {
+                double m_jj = ss->comoments[(size_t) j * nvar + j];
+                double r    = i == j ? 1.0f : m_i[j] / sqrt(m_i[i] * m_jj);
+                df->cov[(size_t) i * nvar + j] = r;
+                df->cov[(size_t) j * nvar + i] = r;
+            }
+        }
+        return df;
+    }
+    df->nobs    = ss->n_rows;
+    df->df      = calloc(nvar, sizeof(void *));
+    df->weights = malloc((ss->n_rows + 1) * sizeof(int));
+    if (!df->df || !df->weights)
+        goto ERR;
+    for (int i = 0; i < nvar; ++i) {
+        df->df[i] = malloc((ss->n_rows + 1) * sizeof(int));
+        if (!df->df[i])
+            goto ERR;
+    }
+    int k = 0;
+    for (int slot = 0; slot < ss->capacity; ++slot) {
+        if (!ss->counts[slot])
+            continue;
+        int *row = ss->rows + (size_t) slot * nvar;
+        for (int i = 0; i < nvar; ++i)
+            ((int *) df->df[i])[k] = row[i];
+        df->weights[k++] = ss->counts[slot];
+    }
+    return df;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for causality dataframe.\n");
+    if (df)
+        free_suff_stats_dataframe(df);
+    return NULL;
+}
+
+void free_suff_stats_dataframe(struct dataframe *df)
+{
+    if (df->df) {
+        for (int i = 0; i < df->nvar; ++i)
+            free(df->df[i]);
+        free(df->df);
+    }
+    free(df->cov);
+    free(df->weights);
+    free(df);
+}
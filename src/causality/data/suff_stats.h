@@ -0,0 +1,36 @@
+#ifndef SUFF_STATS_H
+#define SUFF_STATS_H
+
+#include <dataframe.h>
+
+#define SUFF_STATS_MAGIC "CCFSTAT1"
+
+/*
+ * suff_stats stores the sufficient statistics of a dataset, so the dataset can
+ * be processed in chunks (or shards, in different processes) whose statistics
+ * are merged. The variables are either all continuous, in which case the
+ * means and the centered cross products (comoments) are kept, or all
+ * discrete, in which case a sparse contingency table is kept: a hash table of
+ * the distinct rows of the dataset, and how often each occurs.
+ */
+struct suff_stats {
+    int     nvar;
+    int     nobs;
+    int    *states;    /* 0 for continuous variables                  */
+    double *mean;      /* nvar means (continuous)                     */
+    double *comoments; /* nvar x nvar, upper triangle (continuous)    */
+    int     n_rows;    /* number of distinct rows (discrete)          */
+    int     capacity;  /* number of slots in the hash table           */
+    int    *rows;      /* capacity x nvar rows                        */
+    int    *counts;    /* capacity counts, 0 for an empty slot        */
+};
+
+struct suff_stats * create_suff_stats(int nvar, int *states);
+void free_suff_stats(struct suff_stats *ss);
+int  accumulate_suff_stats(struct suff_stats *ss, struct dataframe *chunk);
+int  merge_suff_stats(struct suff_stats *a, struct suff_stats *b);
+int  write_suff_stats(struct suff_stats *ss, const char *path);
+struct suff_stats * read_suff_stats(const char *path);
+struct dataframe * suff_stats_dataframe(struct suff_stats *ss);
+void free_suff_stats_dataframe(struct dataframe *df);
+#endif
@@ -1,11 +1,30 @@
 #ifndef DATAFRAME_H
 #define DATAFRAME_H
 
-/* This just defines the structure. R causality, for example implements it. */
+#define DATAFRAME_ALIGNMENT 64
+
+struct adtree;
+
+/*
+ * This just defines the structure. R causality, for example implements it.
+ * If cov, the nvar x nvar covariance matrix of the (normalized) continuous
+ * variables, is not NULL, the continuous scores use it instead of df. The
+ * BIC scores only need the covariances, so a dataframe can also hold just
+ * the sufficient statistics of continuous data: cov and nobs, with df NULL.
+ * If weights is not NULL, row i of the discrete variables stands for
+ * weights[i] observations, and nobs is the number of rows. The continuous
+ * columns must be aligned to 32 bytes, which the linear algebra kernels
+ * assume; prepare_dataframe aligns every column to DATAFRAME_ALIGNMENT.
+ * If adtree is not NULL, the discrete scores count from it instead of from
+ * the rows.
+ */
 struct dataframe {
-    void **df;
-    int   *states;
-    int    nvar;
-    int    nobs;
+    void  **df;
+    int    *states;
+    int     nvar;
+    int     nobs;
+    double *cov;
+    int    *weights;
+    struct adtree *adtree;
 };
 #endif /* dataframe.h */
@@ -18,6 +18,7 @@
 
 #include <ges/ges_internal.h>
 #include <ges/ges.h>
+#include <scores/score_cache.h>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -48,43 +49,295 @@ static int is_valid_deletion(struct cgraph *cg, struct ges_operator *op)
     return valid_bes_clique(cg, op);
 }
 
+static int degree_in_cgraph(struct cgraph *cg, int node)
+{
+    return size_edge_list(cg->parents[node]) +
+               size_edge_list(cg->spouses[node]) +
+               size_edge_list(cg->children[node]);
+}
+
+/*
+ * max_tail_size returns the largest set T the insertion operator op can have
+ * without giving y more than max_parents parents, i.e. without
+ * |Pa(y) U nayx U T U x| exceeding max_parents. If inserting x --> y would
+ * give x or y more than max_degree adjacents, or y too many parents for any T,
+ * -1 is returned. Neither limit depends on T, so both are checked before any
+ * scoring or cycle testing.
+ */
+static int max_tail_size(struct cgraph *cg, struct ges_operator *op,
+                             struct ges_settings *settings)
+{
+    if (settings->max_degree > 0) {
+        if (degree_in_cgraph(cg, op->xp) >= settings->max_degree ||
+                degree_in_cgraph(cg, op->y) >= settings->max_degree)
+            return -1;
+    }
+    if (settings->max_parents <= 0)
+        return op->set_size;
+    int n = settings->max_parents - (op->n_parents + op->nayx_size + 1);
+    if (n < 0)
+        return -1;
+    return n < op->set_size ? n : op->set_size;
+}
+
+/*
+ * forbidden_tails returns the bitmask of the nodes t in S such that the edge
+ * t --> y is forbidden by know. T cannot contain any of them, since applying
+ * the operator orients t --> y for all t in T.
+ */
+static uint64_t forbidden_tails(struct ges_operator *op,
+                                    struct ges_knowledge *know)
+{
+    uint64_t mask = 0;
+    for (int i = 0; know && i < op->set_size; ++i) {
+        if (ges_edge_forbidden(know, op->set[i], op->y))
+            mask |= (uint64_t) 1 << i;
+    }
+    return mask;
+}
+
+static int tail_size(struct ges_operator *op)
+{
+    int n = 0;
+    for (int i = 0; i < op->set_size; ++i)
+        n += IS_TAIL_NODE(op->t, i) ? 1 : 0;
+    return n;
+}
+
+/*
+ * within_limits returns whether or not applying the insertion operator op
+ * respects the maximum number of parents and adjacents in settings.
+ */
+static int within_limits(struct cgraph *cg, struct ges_operator *op,
+                             struct ges_settings *settings)
+{
+    return tail_size(op) <= max_tail_size(cg, op, settings);
+}
+
+#define MAX_PRUNED_SETS 64
+#define MIN_BOUNDED_SETS 2 /* free nodes a set needs to be worth bounding */
+
+/*
+ * subset_pruner records the sets H whose supersets are skipped by the
+ * deletion operators, because no superset can score better than the best set
+ * found so far, and counts how many sets were considered and skipped by the
+ * operators.
+ */
+struct subset_pruner {
+    uint64_t sets[MAX_PRUNED_SETS];
+    int      n_sets;
+    long     n_subsets;
+    long     n_pruned;
+};
+
+static int is_pruned(struct subset_pruner *pr, uint64_t set)
+{
+    for (int i = 0; i < pr->n_sets; ++i) {
+        if ((set & pr->sets[i]) == pr->sets[i])
+            return 1;
+    }
+    return 0;
+}
+
+static void prune_supersets(struct subset_pruner *pr, uint64_t set)
+{
+    if (pr->n_sets < MAX_PRUNED_SETS)
+        pr->sets[pr->n_sets++] = set;
+}
+
+static void count_subsets(struct ges_score gs, struct subset_pruner *pr)
+{
+    if (!gs.subsets)
+        return;
+    #pragma omp atomic
+    gs.subsets->n_subsets += pr->n_subsets;
+    #pragma omp atomic
+    gs.subsets->n_pruned += pr->n_pruned;
+}
+
+/* free_nodes returns how many of the n nodes of a mask set may still be added */
+static int free_nodes(uint64_t set, uint64_t forbidden, int n)
+{
+    int n_free = 0;
+    for (int i = 0; i < n; ++i)
+        n_free += !IS_TAIL_NODE(set | forbidden, i);
+    return n_free;
+}
+
+/*
+ * Only BIC and discrete BIC have bounds on their score differences; BDeu has
+ * no penalty to bound it with.
+ */
+static int has_score_bounds(struct ges_score gs)
+{
+    return gs.gsf == ges_bic_score || gs.gsf == ges_discrete_bic_score;
+}
+
+static double score_lower_bound(struct ges_score gs, int xp, int y, int *lo,
+                                    int n_lo, int *hi, int n_hi)
+{
+    if (gs.gsf == ges_bic_score)
+        return ges_bic_lower_bound(&gs, xp, lo, n_lo, hi, n_hi);
+    return ges_discrete_bic_lower_bound(&gs, xp, y, lo, n_lo);
+}
+
+static double score_upper_bound(struct ges_score gs, int xp, int y, int *lo,
+                                    int n_lo, int *hi, int n_hi)
+{
+    if (gs.gsf == ges_bic_score)
+        return ges_bic_upper_bound(&gs, xp, lo, n_lo, hi, n_hi);
+    return ges_discrete_bic_upper_bound(&gs, xp, y, hi, n_hi);
+}
+
+/*
+ * tail_search holds the state of the enumeration of the sets T of an insertion
+ * operator: the best operator found so far, the paths for its cycle tests, the
+ * adjacency masks among the nodes of S, and the parent set Pa(y) U nayx
+ * followed by the nodes of T.
+ */
+struct tail_search {
+    struct ges_score     gs;
+    struct ges_operator *op;
+    struct ges_operator  o;
+    struct tail_paths   *paths;
+    int                  max_t;
+    uint64_t            *adj;
+    int                 *py_nayx_t;
+    int                  py_nayx_size;
+    int                 *py_nayx_s;  /* buffer for the upper sets of bounds */
+    long                 n_visited;
+};
+
+/*
+ * search_tails scores the operator with the set T = t, which has n_t nodes,
+ * and then the supersets of t that extend it by the nodes in cand, each of
+ * which is adjacent to every node in T U nayx. Since only the nodes in cand
+ * are added, every set visited is a clique; sets that are not cliques are
+ * never visited. The sets are extended by nodes in increasing order, so every
+ * set visited from t is a superset of t, and they are all skipped at once if
+ * the score bounds show that none of them can beat the best T found so far.
+ */
+static void search_tails(struct tail_search *ts, uint64_t t, int n_t,
+                             uint64_t cand)
+{
+    struct ges_operator *o = &ts->o;
+    struct ges_score     gs = ts->gs;
+    int n = ts->py_nayx_size + n_t;
+    ts->n_visited++;
+    o->t = t;
+    if (!tail_creates_cycle(ts->paths, t)) {
+        /* score_diff = score(y, pay_nayx_t_x) - score(y, pay_nayx_t) */
+        o->score_diff = gs.gsf(gs.df, o->xp, o->y, ts->py_nayx_t, n, gs.args,
+                                   gs.gsm);
+        /* ties go to the smallest t, as when the sets are visited in order */
+        if (o->score_diff < ts->op->score_diff ||
+                (o->score_diff == ts->op->score_diff && t < ts->op->t))
+            *ts->op = *o;
+    }
+    if (n_t >= ts->max_t || !cand)
+        return;
+    if (ts->py_nayx_s &&
+            free_nodes(t, ~cand, o->set_size) >= MIN_BOUNDED_SETS) {
+        int n_hi = n;
+        memcpy(ts->py_nayx_s, ts->py_nayx_t, n * sizeof(int));
+        for (int i = 0; i < o->set_size; ++i) {
+            if (IS_TAIL_NODE(cand, i))
+                ts->py_nayx_s[n_hi++] = o->set[i];
+        }
+        if (score_lower_bound(gs, o->xp, o->y, ts->py_nayx_t, n, ts->py_nayx_s,
+                                  n_hi) > ts->op->score_diff)
+            return;
+    }
+    for (int i = 0; i < o->set_size; ++i) {
+        if (!IS_TAIL_NODE(cand, i))
+            continue;
+        uint64_t bit = (uint64_t) 1 << i;
+        ts->py_nayx_t[n] = o->set[i];
+        /* the nodes after i that are adjacent to every node in T U i */
+        search_tails(ts, t | bit, n_t + 1,
+                         cand & ts->adj[i] & ~(bit | (bit - 1)));
+    }
+}
+
+/* n_choose_at_most returns the number of subsets of n nodes with <= k nodes */
+static long n_choose_at_most(int n, int k)
+{
+    long sum  = 0;
+    long term = 1;
+    for (int i = 0; i <= k && i <= n; ++i) {
+        sum += term;
+        term = term * (n - i) / (i + 1);
+    }
+    return sum;
+}
+
 /*
  * score_insertion_operator takes the insertion operator op and modifies it by
  * finding the (valid) set T (where T is in the powerset of S) that minimizes
  * the quantity score((py, nayx, T, x), y) - score((py, nayx, T), y).
  * The function also modifies op by setting the score_diff field to the best
- * score difference. If there is no valid T, then op is unmodified.
+ * score difference. If there is no valid T, then op is unmodified. Sets T
+ * with more than max_t nodes, or that intersect forbidden_t, are skipped
+ * without being tested. The adjacencies among S U nayx are computed once as
+ * bitmasks, and only the sets T for which T U nayx is a clique are visited
+ * (see search_tails). Likewise, the semi-directed paths from y to x are
+ * searched once, and each set T is tested for a cycle against them.
  */
 void score_insertion_operator(struct cgraph *cg, struct ges_operator *op,
                                                         struct ges_score gs,
-                                                        int *cycle_test_mem)
+                                                        int *cycle_test_mem,
+                                                        int max_t,
+                                                        uint64_t forbidden_t)
 {
     struct ges_operator o = *op;
-    /* allocate enough memory on the stack to store all of Pa(y) U nayx U S */
+    uint64_t adj[o.set_size + 1];
+    int n_free = free_nodes(0, forbidden_t, o.set_size);
+    struct subset_pruner pr = {{0}, 0, n_choose_at_most(n_free, max_t), 0};
+    /* T U nayx can only be a clique if nayx is one */
+    o.t = 0;
+    if (!valid_fes_clique(cg, &o)) {
+        pr.n_pruned = pr.n_subsets;
+        count_subsets(gs, &pr);
+        return;
+    }
+    /* the nodes of S that may be in T are adjacent to every node in nayx */
+    uint64_t cand = 0;
+    for (int i = 0; i < o.set_size; ++i) {
+        if (IS_TAIL_NODE(forbidden_t, i))
+            continue;
+        int j = 0;
+        while (j < o.nayx_size && adjacent_in_cgraph(cg, o.set[i], o.nayx[j]))
+            j++;
+        if (j == o.nayx_size)
+            cand |= (uint64_t) 1 << i;
+    }
+    adjacency_masks(cg, o.set, o.set_size, adj);
+    /* the paths y ~~> x only need to be cut at the nodes that may be in T */
+    struct tail_paths paths;
+    find_tail_paths(cg, &o, max_t > 0 ? cand : 0, cycle_test_mem, &paths);
+    /* no T cuts a path from y to x that passes none of S */
+    if (paths.y_to_x) {
+        pr.n_pruned = pr.n_subsets;
+        count_subsets(gs, &pr);
+        return;
+    }
+    /* allocate enough memory to store all of Pa(y) U nayx U S */
     int py_nayx_size = o.nayx_size + o.n_parents;
     int *py_nayx_t = malloc ((py_nayx_size + o.set_size) * sizeof(int));
     for (int i = 0; i < o.n_parents; ++i)
         py_nayx_t[i] = o.parents[i];
     for (int i = 0; i < o.nayx_size; ++i)
         py_nayx_t[i + o.n_parents] = o.nayx[i];
-    /* iterate through the powerset of S via bit operations.  */
-    uint64_t powerset_size = 1 << o.set_size; /* |P(S)|  = 2^|S| */
-    for (o.t = 0; o.t < powerset_size; ++o.t) {
-        if (!is_valid_insertion(cg, &o, cycle_test_mem))
-            continue;
-        int py_nayx_t_size = py_nayx_size;
-        for (int i = 0; i < o.set_size; ++i) {
-            /* We now need to score the valid operator. We add t to py_nayx_t */
-            if (IS_TAIL_NODE(o.t, i))
-                py_nayx_t[py_nayx_t_size++] = o.set[i];
-        }
-        /* score_diff = score(y, pay_nayx_t_x) - score(y, pay_nayx_t) */
-        o.score_diff = gs.gsf(gs.df, o.xp, o.y, py_nayx_t, py_nayx_t_size,
-                                     gs.args, gs.gsm);
-        if (o.score_diff < op->score_diff)
-            *op = o;
-    }
+    int *py_nayx_s = NULL;
+    if (has_score_bounds(gs) && o.set_size >= MIN_BOUNDED_SETS)
+        py_nayx_s = malloc((py_nayx_size + o.set_size) * sizeof(int));
+    struct tail_search ts = {gs, op, o, &paths, max_t, adj,
+                                 py_nayx_t, py_nayx_size, py_nayx_s, 0};
+    search_tails(&ts, 0, 0, cand);
+    pr.n_pruned = pr.n_subsets - ts.n_visited;
+    count_subsets(gs, &pr);
     free(py_nayx_t);
+    free(py_nayx_s);
 }
 
 /*
@@ -92,24 +345,43 @@ void score_insertion_operator(struct cgraph *cg, struct ges_operator *op,
  * finding the (valid) set H (where H is in the powerset of nayx/x) that
  * minimizes the quantity -(score((py, nayx/H, x), y) - score((py, nayx/H, y)).
  * The function also modifies op by setting the score_diff field to the best
- * score difference. If there is no valid H, then op is unmodified.
+ * score difference. If there is no valid H, then op is unmodified. Sets H
+ * that intersect forbidden_h are skipped, as are the supersets of a set H if
+ * the score bounds show that none of them can beat the best H found so far.
+ * The adjacencies among nayx are computed once, as bitmasks, for the clique
+ * checks of all the sets H.
  */
 void score_deletion_operator(struct cgraph *cg, struct ges_operator *op,
-                                                struct ges_score gs)
+                                                struct ges_score gs,
+                                                uint64_t forbidden_h)
 {
-    struct ges_operator o = *op;
+    struct ges_operator  o  = *op;
+    struct subset_pruner pr = {{0}, 0, 0, 0};
     /* allocate enough memory on the stack to store all of Pa(y) U nayx */
     int py_size = 0;
-    int py_nayx_mh[o.n_parents + o.nayx_size];
+    int py_nayx_mh[o.n_parents + o.nayx_size + 1];
+    int py_lo[o.n_parents + o.nayx_size + 1];
     /* add pa(y) != x to py_nayx_smh */
     for (int i = 0; i < o.n_parents; ++i) {
         if (o.parents[i] != o.xp)
             py_nayx_mh[py_size++] = o.parents[i];
     }
+    int bounded = has_score_bounds(gs) && o.nayx_size >= MIN_BOUNDED_SETS;
+    /* nayx/H must be a clique; test it against the adjacencies among nayx */
+    uint64_t adj[o.nayx_size + 1];
+    uint64_t nayx_mask = ((uint64_t) 1 << o.nayx_size) - 1;
+    adjacency_masks(cg, o.nayx, o.nayx_size, adj);
     /* iterate through the powerset of nayx via bit operations.  */
     uint64_t powerset_size = 1 << o.nayx_size;
     for (o.h = 0; o.h < powerset_size; ++o.h) {
-        if (!is_valid_deletion(cg, &o))
+        if (o.h & forbidden_h)
+            continue;
+        pr.n_subsets++;
+        if (is_pruned(&pr, o.h)) {
+            pr.n_pruned++;
+            continue;
+        }
+        if (!is_clique_mask(nayx_mask & ~o.h, adj, o.nayx_size))
             continue;
         /* add nayx_smh to py_nayx_smh (nayx minus h ) */
         int py_nayx_mh_size = py_size;
@@ -121,7 +393,22 @@ void score_deletion_operator(struct cgraph *cg, struct ges_operator *op,
                                         gs.args, gs.gsm);
         if (o.score_diff < op->score_diff)
             *op = o;
+        if (!bounded ||
+                free_nodes(o.h, forbidden_h, o.nayx_size) < MIN_BOUNDED_SETS)
+            continue;
+        /* the supersets of H keep at least the forbidden heads in nayx/H */
+        int py_lo_size = py_size;
+        memcpy(py_lo, py_nayx_mh, py_size * sizeof(int));
+        for (int i = 0; i < o.nayx_size; ++i) {
+            if (!IS_HEAD_NODE(o.h, i) && IS_HEAD_NODE(forbidden_h, i) &&
+                    o.nayx[i] != o.xp)
+                py_lo[py_lo_size++] = o.nayx[i];
+        }
+        if (-score_upper_bound(gs, o.xp, o.y, py_lo, py_lo_size, py_nayx_mh,
+                                   py_nayx_mh_size) >= op->score_diff)
+            prune_supersets(&pr, o.h);
     }
+    count_subsets(gs, &pr);
 }
 
 void apply_optimization1(struct cgraph *cg, int y, int n,
@@ -144,39 +431,316 @@ static void update_operator_info(struct cgraph *cg, struct ges_operator *op)
 
 }
 
-void update_insertion_operator(struct cgraph *cg, struct ges_operator *op,
-                                                         struct ges_score gs,
-                                                         int *cycle_test_mem)
+/*
+ * score_insertion_pair finds the best valid insertion operator x --> y, given
+ * the parents of y. The caller is responsible for freeing the set and nayx of
+ * the returned operator.
+ */
+static struct ges_operator score_insertion_pair(struct cgraph *cg, int x,
+                                                    int y, int *parents,
+                                                    int n_parents,
+                                                    struct ges_settings
+                                                    *settings,
+                                                    struct ges_score gs,
+                                                    int *cycle_test_mem)
 {
-    op->score_diff = DEFAULT_SCORE_DIFF;
+    struct ges_operator o = {x, y, {0}, NULL, NULL, parents, n_parents, 0, 0,
+                                 DEFAULT_SCORE_DIFF};
+    if (ges_edge_forbidden(settings->knowledge, x, y))
+        return o;
+    /* Split y's neighbors into set (nonadj to x) and nayx (adj to x) */
+    partition_neighbors(cg, &o);
+    int max_t = max_tail_size(cg, &o, settings);
+    if (max_t >= 0) {
+        uint64_t forbidden_t = forbidden_tails(&o, settings->knowledge);
+        score_insertion_operator(cg, &o, gs, cycle_test_mem, max_t,
+                                     forbidden_t);
+    }
+    return o;
+}
+
+/*
+ * score_batched_pair is score_insertion_pair for a node y with no neighbors,
+ * given the score difference of x --> y from ges_bic_score_batch. Then the
+ * only operator has T = {}, which is scored if it is valid.
+ */
+static struct ges_operator score_batched_pair(struct cgraph *cg, int x, int y,
+                                                  int *parents, int n_parents,
+                                                  struct ges_settings
+                                                  *settings, double score_diff,
+                                                  int *cycle_test_mem)
+{
+    struct ges_operator o = {x, y, {0}, NULL, NULL, parents, n_parents, 0, 0,
+                                 DEFAULT_SCORE_DIFF};
+    if (ges_edge_forbidden(settings->knowledge, x, y))
+        return o;
+    if (max_tail_size(cg, &o, settings) >= 0 &&
+            is_valid_insertion(cg, &o, cycle_test_mem) &&
+            score_diff < o.score_diff)
+        o.score_diff = score_diff;
+    return o;
+}
+
+/*
+ * update_insertion_row rescores every insertion operator x --> y into the
+ * given y and stores the operators that improve the score in tbl. If cand is
+ * not NULL, only the candidate parents of y are considered.
+ */
+void update_insertion_row(struct cgraph *cg, struct ges_table *tbl, int y,
+                              struct ges_candidates *cand,
+                              struct ges_settings *settings,
+                              struct ges_score gs, int *cycle_test_mem)
+{
+    struct ges_operator py = {0};
+    py.y = y;
+    calculate_parents(cg, &py);
+    clear_table_row(tbl, y);
+    int *xs  = NULL;
+    int  n_x = cg->n_nodes;
+    if (cand) {
+        xs  = cand->nodes + cand->offsets[y];
+        n_x = cand->offsets[y + 1] - cand->offsets[y];
+    }
     /* precalculate the covariances common to all calculations */
-    apply_optimization1(cg, op->y, cg->n_nodes, &gs);
-    for (int x = 0; x < cg->n_nodes; ++x) {
-        if (x == op->y || adjacent_in_cgraph(cg, x, op->y))
-            continue;
-        apply_optimization2(cg, x, &gs);
-        struct ges_operator o = {x, op->y, {0}, NULL, NULL, op->parents,
-                                    op->n_parents, 0, 0, DEFAULT_SCORE_DIFF};
-        /* Split y's neighbors into set (nonadj to x) and nayx (adj to x) */
-        partition_neighbors(cg, &o);
-        score_insertion_operator(cg, &o, gs, cycle_test_mem);
-        if (o.score_diff < op->score_diff) {
-            free(op->set);
-            free(op->nayx);
-            *op = o;
+    if (!cand)
+        apply_optimization1(cg, y, cg->n_nodes, &gs);
+    else if (gs.gsf == ges_bic_score)
+        ges_bic_optimization_subset(cg, y, xs, n_x, &gs);
+    /*
+     * forbidden operators are skipped here, before any covariances are
+     * calculated for them; the row was cleared, so they have no entries
+     */
+    int *nodes = malloc((n_x + 1) * sizeof(int));
+    int  n     = 0;
+    for (int i = 0; i < n_x; ++i) {
+        int x = xs ? xs[i] : i;
+        if (x != y && !adjacent_in_cgraph(cg, x, y) &&
+                !ges_edge_forbidden(settings->knowledge, x, y))
+            nodes[n++] = x;
+    }
+    /*
+     * If y has no neighbors, nayx and T are empty for every operator x --> y,
+     * so they all condition on Pa(y) alone, and BIC scores them at once.
+     */
+    double *batch = NULL;
+    if (gs.gsf == ges_bic_score && !cg->spouses[y]) {
+        batch = malloc((n + 1) * sizeof(double));
+        if (batch && ges_bic_score_batch(&gs, y, nodes, n, batch)) {
+            free(batch);
+            batch = NULL;
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        int x = nodes[i];
+        struct ges_operator o;
+        if (batch) {
+            o = score_batched_pair(cg, x, y, py.parents, py.n_parents,
+                                       settings, batch[i], cycle_test_mem);
         }
         else {
-            free(o.set);
-            free(o.nayx);
+            apply_optimization2(cg, x, &gs);
+            o = score_insertion_pair(cg, x, y, py.parents, py.n_parents,
+                                         settings, gs, cycle_test_mem);
         }
+        set_table_entry(tbl, x, y, o.t, o.score_diff);
+        free(o.set);
+        free(o.nayx);
+    }
+    free(nodes);
+    free(batch);
+    free(py.parents);
+    if (gs.gsf == ges_bic_score)
+        free_ges_score_mem(gs.gsm);
+}
+
+/*
+ * update_insertion_pair rescores the single insertion operator x --> y and
+ * updates its entry in tbl.
+ */
+static void update_insertion_pair(struct cgraph *cg, struct ges_table *tbl,
+                                      int x, int y,
+                                      struct ges_candidates *cand,
+                                      struct ges_settings *settings,
+                                      struct ges_score gs, int *cycle_test_mem)
+{
+    if (x == y || adjacent_in_cgraph(cg, x, y) ||
+            (cand && !is_candidate(cand, x, y))) {
+        remove_table_entry(tbl, x, y);
+        return;
     }
+    struct ges_operator py = {0};
+    py.y = y;
+    calculate_parents(cg, &py);
+    if (gs.gsf == ges_bic_score)
+        ges_bic_optimization_pair(cg, x, y, &gs);
+    struct ges_operator o = score_insertion_pair(cg, x, y, py.parents,
+                                                     py.n_parents, settings,
+                                                     gs, cycle_test_mem);
+    set_table_entry(tbl, x, y, o.t, o.score_diff);
+    free(o.set);
+    free(o.nayx);
+    free(py.parents);
     if (gs.gsf == ges_bic_score)
         free_ges_score_mem(gs.gsm);
 }
 
+/*
+ * select_insertion_operator sets op to the best insertion operator into op->y
+ * stored in tbl. If there is none, op is given the default score difference.
+ */
+static void select_insertion_operator(struct cgraph *cg, struct ges_operator
+                                          *op, struct ges_table *tbl)
+{
+    struct ges_operator o = {-1, op->y, {0}, NULL, NULL, NULL, 0, 0, 0,
+                                 DEFAULT_SCORE_DIFF};
+    free(op->parents);
+    free(op->set);
+    free(op->nayx);
+    calculate_parents(cg, &o);
+    struct ges_entry *e = best_table_entry(tbl, o.y);
+    if (e) {
+        o.xp         = e->x;
+        o.t          = e->t;
+        o.score_diff = e->score_diff;
+        partition_neighbors(cg, &o);
+    }
+    *op = o;
+}
 
+/*
+ * step0_parents stores in xs the nodes x whose operators x --> y are scored
+ * in FES STEP 0, when y has no adjacents, and returns how many there are.
+ * Then the score of x --> y is the score of y --> x if x has no adjacents
+ * either, so such pairs are only scored into the larger node, unless
+ * background knowledge forbids that direction.
+ */
+int step0_parents(struct cgraph *cg, int y, struct ges_candidates *cand,
+                      struct ges_settings *settings, int *xs)
+{
+    struct ges_knowledge *know = settings->knowledge;
+    int  n_x = cg->n_nodes;
+    int *c   = NULL;
+    if (cand) {
+        c   = cand->nodes + cand->offsets[y];
+        n_x = cand->offsets[y + 1] - cand->offsets[y];
+    }
+    int n = 0;
+    for (int i = 0; i < n_x; ++i) {
+        int x = c ? c[i] : i;
+        if (x == y || ges_edge_forbidden(know, x, y))
+            continue;
+        int degree = degree_in_cgraph(cg, x);
+        if (x > y && !degree && !ges_edge_forbidden(know, y, x))
+            continue;
+        if (settings->max_degree > 0 && degree >= settings->max_degree)
+            continue;
+        xs[n++] = x;
+    }
+    return n;
+}
+
+#define ROW_RESCORE  1
+#define ROW_RESELECT 2
+
+static void mark_row(int y, int mark, unsigned char *row_marks, int *rows,
+                         int *n_rows)
+{
+    if (!row_marks[y])
+        rows[(*n_rows)++] = y;
+    row_marks[y] |= mark;
+}
+
+/*
+ * update_insertion_operators brings tbl up to date after x --> y has been
+ * inserted and cg has been reoriented. Reorienting never changes adjacencies,
+ * so the only adjacency that changed is x --- y. The operators into a node are
+ * all rescored if its parents or spouses changed, or if it is a common
+ * neighbor of x and y (T U nayx may now form a clique). Otherwise, only the
+ * operators x --> w, for w a neighbor of y, and y --> w, for w a neighbor of
+ * x, are rescored, as y (or x) moved from S to nayx. The nodes whose best
+ * operator may have changed are stored in rows in ascending order, and the
+ * number of them is returned.
+ */
+static int update_insertion_operators(struct cgraph *cg, struct ges_table *tbl,
+                                          int x, int y, int *rows,
+                                          unsigned char *row_marks,
+                                          struct ges_candidates *cand,
+                                          struct ges_settings *settings,
+                                          struct ges_score gs,
+                                          int *cycle_test_mem)
+{
+    int n_rows = 0;
+    int n      = get_operators_to_update(rows, cg);
+    for (int i = 0; i < n; ++i) {
+        int node = rows[i];
+        row_marks[node] = 0;
+        if (parents_or_spouses_changed_in_cgraph(cg, node))
+            row_marks[node] = ROW_RESCORE;
+    }
+    for (int i = 0; i < n; ++i) {
+        if (row_marks[rows[i]])
+            rows[n_rows++] = rows[i];
+    }
+    struct edge_list *p = cg->spouses[x];
+    while (p) {
+        if (edge_undirected_in_cgraph(cg, p->node, y))
+            mark_row(p->node, ROW_RESCORE, row_marks, rows, &n_rows);
+        p = p->next;
+    }
+    remove_table_entry(tbl, x, y);
+    remove_table_entry(tbl, y, x);
+    mark_row(x, ROW_RESELECT, row_marks, rows, &n_rows);
+    mark_row(y, ROW_RESELECT, row_marks, rows, &n_rows);
+    for (p = cg->spouses[y]; p; p = p->next) {
+        if (row_marks[p->node] & ROW_RESCORE)
+            continue;
+        update_insertion_pair(cg, tbl, x, p->node, cand, settings, gs,
+                                  cycle_test_mem);
+        mark_row(p->node, ROW_RESELECT, row_marks, rows, &n_rows);
+    }
+    for (p = cg->spouses[x]; p; p = p->next) {
+        if (row_marks[p->node] & ROW_RESCORE)
+            continue;
+        update_insertion_pair(cg, tbl, y, p->node, cand, settings, gs,
+                                  cycle_test_mem);
+        mark_row(p->node, ROW_RESELECT, row_marks, rows, &n_rows);
+    }
+    for (int i = 0; i < n_rows; ++i) {
+        if (row_marks[rows[i]] & ROW_RESCORE)
+            update_insertion_row(cg, tbl, rows[i], cand, settings, gs,
+                                 cycle_test_mem);
+        row_marks[rows[i]] = 0;
+    }
+    sort_nodes(rows, n_rows);
+    return n_rows;
+}
+
+/*
+ * forbidden_heads returns the bitmask of the nodes h in nayx such that
+ * applying the deletion operator op with h in H would orient a forbidden
+ * edge y --> h or x --> h.
+ */
+static uint64_t forbidden_heads(struct cgraph *cg, struct ges_operator *op,
+                                    struct ges_knowledge *know)
+{
+    uint64_t mask = 0;
+    for (int i = 0; know && i < op->nayx_size; ++i) {
+        int h = op->nayx[i];
+        if (ges_edge_forbidden(know, op->y, h) ||
+                (edge_undirected_in_cgraph(cg, op->xp, h) &&
+                     ges_edge_forbidden(know, op->xp, h)))
+            mask |= (uint64_t) 1 << i;
+    }
+    return mask;
+}
+
+/*
+ * update_deletion_operator finds the best deletion operator x --> y into
+ * op->y. Required edges are never deleted.
+ */
 void update_deletion_operator(struct cgraph *cg, struct ges_operator *op,
-                                                        struct ges_score gs)
+                                  struct ges_knowledge *know,
+                                  struct ges_score gs)
 {
     op->score_diff = DEFAULT_SCORE_DIFF;
     int y = op->y;
@@ -200,12 +764,15 @@ void update_deletion_operator(struct cgraph *cg, struct ges_operator *op,
     /* precalculate the covariances common to all calculations */
     apply_optimization1(cg, y, cg->n_nodes, &gs);
     for (int i = 0; i < n; ++i) {
+        if (ges_edge_required(know, nodes[i], y) ||
+                ges_edge_required(know, y, nodes[i]))
+            continue;
         apply_optimization2(cg, nodes[i], &gs);
         struct ges_operator o = {nodes[i], y, {0}, NULL, NULL, op->parents,
                                      op->n_parents, 0, 0, DEFAULT_SCORE_DIFF};
         /* Calculate the neighbors of y that are adjacent to x */
         calculate_nayx(cg, &o);
-        score_deletion_operator(cg, &o, gs);
+        score_deletion_operator(cg, &o, gs, forbidden_heads(cg, &o, know));
         if (o.score_diff < op->score_diff) {
             free(op->set);
             free(op->nayx);
@@ -257,95 +824,324 @@ static void apply_deletion_operator(struct cgraph *cg, struct ges_operator *op)
 }
 
 /*
- * ccf_ges is a score based causal discovery algorithm that tries to find the
- * pattern that generated dataset in ges_score. The algorithm inputs are the
- * ges_score structure, score, and cg, a cgraph. score contains the dataset,
- * function pointer to the scoring function, and other related information. cg
- * is a pointer to an (initially empty, for now) causality graph that will be
- * filled in by the time the algorithm terminates. ccf_ges returns the score of
- * the pattern.
+ * orient_with_knowledge orients the undirected edges x --- y of the pattern
+ * for which y --> x is forbidden or x --> y is required, and then applies the
+ * meek rules to propagate the orientations.
  */
-double ccf_ges(struct ges_score score, struct cgraph *cg)
+void orient_with_knowledge(struct cgraph *cg, struct ges_knowledge *know)
+{
+    int  n_nodes = cg->n_nodes;
+    int *nodes   = malloc(n_nodes * sizeof(int));
+    int  n_oriented = 0;
+    for (int x = 0; x < n_nodes; ++x) {
+        int n = 0;
+        struct edge_list *p = cg->spouses[x];
+        while (p) {
+            int y = p->node;
+            if (ges_edge_required(know, x, y) ||
+                    (ges_edge_forbidden(know, y, x) &&
+                         !ges_edge_forbidden(know, x, y)))
+                nodes[n++] = y;
+            p = p->next;
+        }
+        for (int i = 0; i < n; ++i)
+            orient_undirected_edge(cg, x, nodes[i]);
+        n_oriented += n;
+    }
+    free(nodes);
+    if (n_oriented)
+        meek_propagate(cg, NULL);
+}
+
+/*
+ * init_ges_search allocates the state of a search on cg. If settings contains
+ * background knowledge, the required edges are added to cg, and cg is turned
+ * into a pattern if it has any edges. Returns nonzero on failure.
+ */
+int init_ges_search(struct ges_search *s, struct ges_score score,
+                        struct cgraph *cg, struct ges_settings *settings)
+{
+    int nvar = cg->n_nodes;
+    memset(s, 0, sizeof(struct ges_search));
+    s->score          = score;
+    s->settings       = settings;
+    /* the discrete scores look their lgammas and logs up in a cache */
+    if ((score.gsf == ges_bdeu_score || score.gsf == ges_discrete_bic_score) &&
+            score.args && !score.args->cache) {
+        s->args       = *score.args;
+        s->args.cache = create_score_cache();
+        s->score.args = &s->args;
+    }
+    s->score.subsets  = &s->subsets;
+    s->cg             = cg;
+    s->ops            = calloc(nvar, sizeof(struct ges_operator));
+    s->heap           = create_heap(nvar, s->ops);
+    s->tbl            = create_ges_table(nvar);
+    s->cycle_test_mem = malloc(nvar * 2 * sizeof(int));
+    s->nodes          = malloc(nvar * sizeof(int));
+    s->row_marks      = calloc(nvar, sizeof(unsigned char));
+    if (create_reorient_mem(&s->reorient_mem, nvar) || !s->ops || !s->heap ||
+            !s->tbl || !s->cycle_test_mem || !s->nodes || !s->row_marks) {
+        CAUSALITY_ERROR("Failed to allocate memory for GES.\n");
+        free_ges_search(s);
+        return 1;
+    }
+    /* seed the graph with the required edges and turn it into a pattern */
+    struct ges_knowledge *know = settings->knowledge;
+    if (know) {
+        for (int x = 0; x < nvar; ++x) {
+            for (int y = 0; y < nvar; ++y) {
+                if (ges_edge_required(know, x, y) &&
+                        !adjacent_in_cgraph(cg, x, y))
+                    add_edge_to_cgraph(cg, x, y, DIRECTED);
+            }
+        }
+    }
+    if (cg->n_edges) {
+        for (int i = 0; i < nvar; ++i)
+            s->nodes[i] = i;
+        reorient(cg, s->nodes, nvar, &s->reorient_mem);
+    }
+    return 0;
+}
+
+void free_ges_search(struct ges_search *s)
 {
-   /*
-    * The number of processors ges is going to use. Right now it is 1,
-    * but this will eventually be passed in as an argument to ges
-    */
-    int nprocs = 1;
+    /* Clean up clean up
+     * everybody everywhere.
+     * Clean up clean up
+     * everybody do your share.
+     */
+    if (s->tbl)
+        free_ges_table(s->tbl);
+    if (s->cand)
+        free_ges_candidates(s->cand);
+    if (s->heap)
+        free_heap(s->heap);
+    for (int i = 0; s->ops && i < s->cg->n_nodes; ++i) {
+        free(s->ops[i].parents);
+        free(s->ops[i].set);
+        free(s->ops[i].nayx);
+    }
+    free(s->ops);
+    free(s->cycle_test_mem);
+    free(s->nodes);
+    free(s->row_marks);
+    free(s->marks);
+    free_reorient_mem(&s->reorient_mem);
+    if (s->score.args == &s->args && s->args.cache)
+        free_score_cache(s->args.cache);
+    memset(s, 0, sizeof(struct ges_search));
+}
+
+/*
+ * ges_step0 screens the candidate parents of each node (if settings asks for
+ * it), and then performs FES STEP 0: For all x,y score x --> y. If y has no
+ * adjacents, x --> y is scored with no parents. Otherwise, all of the
+ * operators into y are scored like they are during the search.
+ */
+void ges_step0(struct ges_search *s, struct ges_stats *stats)
+{
+    struct ges_settings *settings = s->settings;
+    struct ges_score     score    = s->score;
+    struct cgraph       *cg       = s->cg;
+    int nprocs = settings->nthreads > 0 ? settings->nthreads : 1;
     int nvar   = cg->n_nodes;
-    double graph_score = 0.0f;
-    /* TODO */
-    struct ges_operator *ops  = calloc(nvar, sizeof(struct ges_operator));
-    struct ges_heap     *heap = create_heap(nvar, ops);
-    /* FES STEP 0: For all x,y score x --> y */
+    /* only consider the candidate parents of each node */
+    if (settings->max_candidates > 0 && settings->max_candidates < nvar - 1) {
+        s->cand = screen_candidates(cg, score, settings->max_candidates,
+                                        settings->screening, nprocs);
+        if (s->cand && stats) {
+            stats->n_pruned = (long) nvar * (nvar - 1) / 2 -
+                                  s->cand->offsets[nvar] / 2;
+        }
+    }
+    /*
+     * Without candidates, the pairwise statistics are calculated in bulk (see
+     * PAIRWISE_TILE): the covariance matrix for BIC, or the score differences
+     * of the discrete scores.
+     */
+    double *pair_diffs = NULL;
+    if (!s->cand && nvar <= PAIRWISE_MAX_NODES) {
+        if (score.gsf == ges_bic_score && !score.df->cov)
+            ges_bic_covariance_matrix(score.df, nprocs);
+        else
+            pair_diffs = ges_pairwise_score_diffs(s, nprocs);
+    }
+    #pragma omp parallel for num_threads(nprocs) schedule(dynamic)
     for (int y = 0; y < nvar; ++y) {
         struct ges_score local_score = score;
-        double min_score = DEFAULT_SCORE_DIFF;
-        int    xp        = -1;
-        apply_optimization1(cg, y, y, &local_score);
-        for (int x = 0; x < y; ++x) {
-            double score_diff = score.gsf(score.df, x, y, NULL, 0, score.args,
-                                                    local_score.gsm);
-            if (score_diff < min_score) {
-                min_score = score_diff;
-                xp         = x;
+        double *batch = NULL;
+        int    *mem   = malloc(2 * nvar * sizeof(int));
+        if (degree_in_cgraph(cg, y)) {
+            update_insertion_row(cg, s->tbl, y, s->cand, settings,
+                                     local_score, mem);
+        }
+        else {
+            int n_x = step0_parents(cg, y, s->cand, settings, mem);
+            if (score.gsf == ges_bic_score) {
+                ges_bic_optimization_subset(cg, y, mem, n_x, &local_score);
+                batch = malloc((n_x + 1) * sizeof(double));
+                if (batch && ges_bic_score_batch(&local_score, y, mem, n_x,
+                                                        batch)) {
+                    free(batch);
+                    batch = NULL;
+                }
+            }
+            for (int i = 0; i < n_x; ++i) {
+                double score_diff;
+                if (pair_diffs)
+                    score_diff = pair_diffs[(size_t) y * nvar + mem[i]];
+                else if (batch)
+                    score_diff = batch[i];
+                else
+                    score_diff = score.gsf(score.df, mem[i], y, NULL, 0,
+                                               score.args, local_score.gsm);
+                set_table_entry(s->tbl, mem[i], y, 0, score_diff);
             }
+            free(batch);
+            if (score.gsf == ges_bic_score)
+                free_ges_score_mem(local_score.gsm);
+        }
+        free(mem);
+        s->ops[y].y = y;
+        select_insertion_operator(cg, &s->ops[y], s->tbl);
+    }
+    free(pair_diffs);
+    /* the effect edges are a subset of the screened candidates */
+    if (settings->fges) {
+        struct ges_candidates *effect_edges = effect_edges_from_table(s->tbl);
+        if (stats)
+            stats->n_effect_edges = effect_edges->offsets[nvar] / 2;
+        if (settings->faithfulness) {
+            if (s->cand)
+                free_ges_candidates(s->cand);
+            s->cand = effect_edges;
         }
-        if (score.gsf == ges_bic_score)
-            free_ges_score_mem(local_score.gsm);
-        ops[y].xp = xp;
-        ops[y].y  = y;
-        ops[y].score_diff = min_score;
+        else
+            free_ges_candidates(effect_edges);
+    }
+}
+
+/*
+ * ges_subset_pruning returns the fraction of the sets T and H the operators of
+ * the search considered that were pruned without being scored.
+ */
+double ges_subset_pruning(struct ges_search *s)
+{
+    if (!s->subsets.n_subsets)
+        return 0.0f;
+    return (double) s->subsets.n_pruned / s->subsets.n_subsets;
+}
+
+/*
+ * select_insertion_operators sets the operator into each node to the best
+ * insertion operator stored in the table, e.g. after a backward search has
+ * used the operators for deletions.
+ */
+void select_insertion_operators(struct ges_search *s)
+{
+    for (int y = 0; y < s->cg->n_nodes; ++y) {
+        s->ops[y].y = y;
+        select_insertion_operator(s->cg, &s->ops[y], s->tbl);
     }
-    /* TODO */
+}
+
+/*
+ * ges_forward_search runs FES from the insertion operators in s->ops, and
+ * returns the improvement in score. If s->marks is not NULL, the nodes whose
+ * operators are rescored are marked GES_STALE_PROBE.
+ */
+double ges_forward_search(struct ges_search *s)
+{
+    struct cgraph       *cg       = s->cg;
+    struct ges_settings *settings = s->settings;
+    struct ges_heap     *heap     = s->heap;
+    double graph_score = 0.0f;
     build_heap(heap);
-    /* FORWARD EQUIVALENCE SEARCH (FES) */
-    struct cgraph *cpy            = copy_cgraph(cg);
-    int           *cycle_test_mem = malloc(nvar * 2 * nprocs * sizeof(int));
-    int           *nodes          = cycle_test_mem;
-    int           *visited        = cycle_test_mem + nvar;
+    /* record which nodes each applied operator changes */
+    track_cgraph_changes(cg);
     /* extract the operator with the best score from the heap */
     struct ges_operator *op;
     while ((op = peek_heap(heap))->score_diff <= 0.0f) {
-        /* double check to see if the insertion is valid */
-        if (!is_valid_insertion(cg, op, cycle_test_mem)) {
-            remove_heap(heap, op->y);
-            update_insertion_operator(cg, op, score, cycle_test_mem);
+        int x = op->xp;
+        int y = op->y;
+        /*
+         * double check to see if the insertion is valid and respects the
+         * limits in settings. If it is not, only the operator x --> y needs
+         * to be rescored.
+         */
+        if (!within_limits(cg, op, settings) ||
+                !is_valid_insertion(cg, op, s->cycle_test_mem)) {
+            remove_heap(heap, y);
+            update_insertion_pair(cg, s->tbl, x, y, s->cand, settings,
+                                      s->score, s->cycle_test_mem);
+            select_insertion_operator(cg, op, s->tbl);
             insert_heap(heap, op);
             continue;
         }
+        new_cgraph_epoch(cg);
         apply_insertion_operator(cg, op);
         graph_score += op->score_diff;
-        int nodes_to_reorient [2] = {op->xp, op->y};
-        reorient(cg, nodes_to_reorient, 2, visited);
-        int n = get_insertion_operators_to_update(nodes, cpy, cg, op, visited);
-        struct ges_operator *new_ops = malloc(n * sizeof(struct ges_operator));
-        for (int i = 0; i < n; ++i) {
-            new_ops[i] = ops[nodes[i]];
-            remove_heap(heap, nodes[i]);
-            update_operator_info(cg, &new_ops[i]);
-        }
-        /* This step (updating) can be parallelized */
+        int nodes_to_reorient [2] = {x, y};
+        reorient(cg, nodes_to_reorient, 2, &s->reorient_mem);
+        int n = update_insertion_operators(cg, s->tbl, x, y, s->nodes,
+                                               s->row_marks, s->cand,
+                                               settings, s->score,
+                                               s->cycle_test_mem);
         for (int i = 0; i < n; ++i)
-            update_insertion_operator(cg, &new_ops[i], score, cycle_test_mem);
+            remove_heap(heap, s->nodes[i]);
         for (int i = 0; i < n; ++i) {
-            ops[new_ops[i].y] = new_ops[i];
-            insert_heap(heap, &ops[new_ops[i].y]);
+            select_insertion_operator(cg, &s->ops[s->nodes[i]], s->tbl);
+            insert_heap(heap, &s->ops[s->nodes[i]]);
+            if (s->marks)
+                s->marks[s->nodes[i]] |= GES_STALE_PROBE;
         }
-        free(new_ops);
     }
+    return graph_score;
+}
+
+static void mark_adjacents(struct cgraph *cg, int x, unsigned char *marks)
+{
+    marks[x] |= GES_STALE_TABLE;
+    for (struct edge_list *p = cg->parents[x]; p; p = p->next)
+        marks[p->node] |= GES_STALE_TABLE;
+    for (struct edge_list *p = cg->spouses[x]; p; p = p->next)
+        marks[p->node] |= GES_STALE_TABLE;
+    for (struct edge_list *p = cg->children[x]; p; p = p->next)
+        marks[p->node] |= GES_STALE_TABLE;
+}
+
+/*
+ * ges_backward_search runs BES from the current graph, and returns the
+ * improvement in score. BES does not maintain the insertion operator table,
+ * so if s->marks is not NULL, the nodes whose rows of the table a deletion
+ * invalidates are marked GES_STALE_TABLE: the nodes whose parents or
+ * neighbors changed, and the nodes adjacent to x or y, since x (or y) moved
+ * from nayx to S for their operators from y (or x).
+ */
+double ges_backward_search(struct ges_search *s)
+{
+    struct cgraph        *cg   = s->cg;
+    struct ges_heap      *heap = s->heap;
+    struct ges_operator  *ops  = s->ops;
+    struct ges_knowledge *know = s->settings->knowledge;
+    int   *nodes = s->nodes;
+    double graph_score = 0.0f;
     /* BES STEP 0 */
-    for (int i = 0; i < nvar; ++i)
-        update_deletion_operator(cg, &ops[i], score);
+    for (int i = 0; i < cg->n_nodes; ++i)
+        update_deletion_operator(cg, &ops[i], know, s->score);
     build_heap(heap);
     /* BACKWARD EQUIVALENCE SEARCH (BES) */
+    struct ges_operator *op;
     while ((op = peek_heap(heap))->score_diff <= 0.0f) {
         if (!is_valid_deletion(cg, op)) {
             remove_heap(heap, op->y);
-            update_deletion_operator(cg, op, score);
+            update_deletion_operator(cg, op, know, s->score);
             insert_heap(heap, op);
             continue;
         }
+        new_cgraph_epoch(cg);
         apply_deletion_operator(cg, op);
         graph_score += op->score_diff;
         int nodes_to_reorient [2 + op->nayx_size];
@@ -356,34 +1152,82 @@ double ccf_ges(struct ges_score score, struct cgraph *cg)
             if (IS_HEAD_NODE(op->h, i))
             nodes_to_reorient[n_nodes_to_reorient++] = op->nayx[i];
         }
-        reorient(cg, nodes_to_reorient, n_nodes_to_reorient, visited);
-        int n = get_deletion_operators_to_update(nodes, cpy, cg, op, visited);
+        reorient(cg, nodes_to_reorient, n_nodes_to_reorient,
+                     &s->reorient_mem);
+        if (s->marks) {
+            mark_adjacents(cg, op->xp, s->marks);
+            mark_adjacents(cg, op->y, s->marks);
+        }
+        int n = get_operators_to_update(nodes, cg);
         struct ges_operator *new_ops = malloc(n * sizeof(struct ges_operator));
         for (int i = 0; i < n; ++i) {
             new_ops[i] = ops[nodes[i]];
             remove_heap(heap, nodes[i]);
             update_operator_info(cg, &new_ops[i]);
+            if (s->marks)
+                s->marks[nodes[i]] |= GES_STALE_TABLE;
         }
         for (int i = 0; i < n; ++i) {
-            update_deletion_operator(cg, &new_ops[i], score);
+            update_deletion_operator(cg, &new_ops[i], know, s->score);
             ops[nodes[i]] = new_ops[i];
             insert_heap(heap, &ops[nodes[i]]);
         }
         free(new_ops);
     }
-    /* Clean up clean up
-     * everybody everywhere.
-     * Clean up clean up
-     * everybody do your share.
-     */
-    free(cycle_test_mem);
-    free_heap(heap);
-    free_cgraph(cpy);
-    for (int i = 0; i < nvar; ++i) {
-        free(ops[i].parents);
-        free(ops[i].set);
-        free(ops[i].nayx);
-    }
-    free(ops);
+    return graph_score;
+}
+
+/*
+ * ccf_ges is a score based causal discovery algorithm that tries to find the
+ * pattern that generated dataset in ges_score. The algorithm inputs are the
+ * ges_score structure, score, and cg, a cgraph. score contains the dataset,
+ * function pointer to the scoring function, and other related information. cg
+ * is a pointer to a causality graph that will be filled in by the time the
+ * algorithm terminates. cg is usually empty, but it may also be a DAG or a
+ * pattern, e.g. the result of a previous search, in which case the search is
+ * warm started from it: cg is reoriented into a pattern and the operators are
+ * initialized from it. If settings contains background knowledge, the
+ * required edges are added to cg before the search, and operators that would
+ * add a forbidden edge or delete a required one are never scored. settings
+ * controls the search (NULL gives plain GES on one thread), and if stats is
+ * not NULL, statistics about the search are stored in it. ccf_ges returns the
+ * score of the pattern relative to the initial graph.
+ *
+ * In FGES mode (Ramsey et al. 2017), the pairs x, y such that x --> y improves
+ * the score of the empty graph are kept as effect edges. With the one edge
+ * faithfulness assumption, FES only considers inserting effect edges, so the
+ * insertion operators into y are scored only for the effect edges of y.
+ * Independently, the candidate parents of each node can be screened before
+ * the search (see ges_screen.c), which restricts both FES STEP 0 and the
+ * rescoring of the insertion operators to the screened candidates.
+ */
+double ccf_ges(struct ges_score score, struct cgraph *cg,
+                   struct ges_settings *settings, struct ges_stats *stats)
+{
+    struct ges_settings defaults = {.nthreads = 1,
+                                    .screening = SCREEN_CORRELATION};
+    if (!settings)
+        settings = &defaults;
+    if (stats)
+        memset(stats, 0, sizeof(struct ges_stats));
+    struct ges_search s;
+    if (init_ges_search(&s, score, cg, settings))
+        return 0.0f;
+    ges_step0(&s, stats);
+    /* FORWARD EQUIVALENCE SEARCH (FES) */
+    double graph_score = ges_forward_search(&s);
+    /* the operator table is only used by FES */
+    free_ges_table(s.tbl);
+    s.tbl = NULL;
+    if (s.cand) {
+        free_ges_candidates(s.cand);
+        s.cand = NULL;
+    }
+    graph_score += ges_backward_search(&s);
+    if (settings->knowledge)
+        orient_with_knowledge(cg, settings->knowledge);
+    if (stats)
+        stats->subset_pruning = ges_subset_pruning(&s);
+    free_ges_search(&s);
     return graph_score;
 }
@@ -22,11 +22,18 @@ typedef double (*ges_score_func)(struct dataframe *df, int x, int y, int *ypar,
                                      int npar, struct score_args *args,
                                      struct ges_score_mem gsm);
 
+/* how many sets T (or H) the operators considered, and how many were pruned */
+struct ges_subset_counts {
+    long n_subsets;
+    long n_pruned;
+};
+
 struct ges_score {
-    ges_score_func        gsf;
-    struct ges_score_mem  gsm;
-    struct dataframe     *df;
-    struct score_args    *args;
+    ges_score_func            gsf;
+    struct ges_score_mem      gsm;
+    struct dataframe         *df;
+    struct score_args        *args;
+    struct ges_subset_counts *subsets; /* NULL, or where they are counted */
 };
 
 
@@ -40,5 +47,70 @@ double ges_discrete_bic_score(struct dataframe *df, int x, int y, int *ypar,
                                   int npar,struct score_args *args,
                                   struct ges_score_mem gsm);
 
-double ccf_ges(struct ges_score score, struct cgraph *cg);
+/* statistics used to screen the candidate parents of each node */
+#define SCREEN_CORRELATION 0 /* absolute correlation (continuous data)    */
+#define SCREEN_SCORE       1 /* score improvement of the single edge      */
+#define SCREEN_MI          2 /* mutual information (discrete data)        */
+
+/*
+ * ges_knowledge stores background knowledge about the causal structure. Nodes
+ * are assigned to tiers, and a node can only cause nodes in the same or later
+ * tiers. Individual edges x --> y can be forbidden or required; the edge sets
+ * are n_nodes x n_nodes bitsets, where bit y of row x is set if x --> y is in
+ * the set.
+ */
+struct ges_knowledge {
+    int      *tiers;     /* NULL if there are no tiers */
+    uint64_t *forbidden;
+    uint64_t *required;
+    int       n_nodes;
+    int       n_words;   /* number of 64 bit words per bitset row */
+};
+
+struct ges_knowledge * create_ges_knowledge(int n_nodes);
+void free_ges_knowledge(struct ges_knowledge *know);
+int  set_ges_tiers(struct ges_knowledge *know, int *tiers);
+void forbid_ges_edge(struct ges_knowledge *know, int x, int y);
+void require_ges_edge(struct ges_knowledge *know, int x, int y);
+int  ges_edge_forbidden(struct ges_knowledge *know, int x, int y);
+int  ges_edge_required(struct ges_knowledge *know, int x, int y);
+
+/* options that control the search performed by ccf_ges */
+struct ges_settings {
+    int fges;           /* keep the effect edges found in FES STEP 0      */
+    int faithfulness;   /* only insert effect edges (requires fges)       */
+    int nthreads;       /* number of threads used to score operators      */
+    int max_candidates; /* screen K candidate parents per node, 0 for all */
+    int screening;      /* screening statistic                            */
+    int max_parents;    /* maximum number of parents, 0 for no limit      */
+    int max_degree;     /* maximum number of adjacents, 0 for no limit    */
+    struct ges_knowledge *knowledge; /* background knowledge, or NULL     */
+};
+
+/* statistics collected by ccf_ges */
+struct ges_stats {
+    int    n_effect_edges; /* number of pairs x, y that improve the score */
+    long   n_pruned;       /* number of pairs x, y removed by screening   */
+    int    n_rescored;     /* nodes rescored for new data (ges_session)   */
+    double subset_pruning; /* fraction of the sets T and H pruned         */
+};
+
+double ccf_ges(struct ges_score score, struct cgraph *cg,
+                   struct ges_settings *settings, struct ges_stats *stats);
+int ccf_ges_path(struct ges_score score, double *penalties, int n_penalties,
+                    struct cgraph *cg, struct ges_settings *settings,
+                    struct cgraph **cgs, double *scores);
+
+/* a GES search that is kept alive and repaired as batches of data arrive */
+struct ges_session;
+struct ges_session * create_ges_session(struct ges_score score,
+                                            struct cgraph *cg,
+                                            struct ges_settings *settings,
+                                            double tolerance,
+                                            double *graph_score,
+                                            struct ges_stats *stats);
+int  update_ges_session(struct ges_session *session, struct dataframe *df,
+                            double *score_diff, struct ges_stats *stats);
+struct cgraph * ges_session_graph(struct ges_session *session);
+void free_ges_session(struct ges_session *session);
 #endif
@@ -1,8 +1,13 @@
 
 #include <stdlib.h>
+#include <math.h>
 #include <ges/ges.h>
+#include <ges/ges_internal.h>
 #include <causality.h>
 
+/* slack for the rounding of the terms the discrete BIC bounds leave out */
+#define BOUND_SLACK 1e-6
+
 double ges_bdeu_score(struct dataframe *df, int x, int y, int *ypar, int npar,
                                              struct score_args *args,
                                             struct ges_score_mem gsm)
@@ -12,11 +17,9 @@ double ges_bdeu_score(struct dataframe *df, int x, int y, int *ypar, int npar,
     xy[npar + 1] = y;
     for(int i = 0; i < npar; ++i)
         xy[i + 1] = ypar[i];
-    double score_plus  = bdeu_score(df, xy, npar + 1, args);
-    double score_minus = bdeu_score(df, xy + 1, npar, args);
+    double score_diff = bdeu_score_diff(df, xy, npar, args);
     free(xy);
-
-    return score_plus - score_minus;
+    return score_diff;
 }
 
 double ges_discrete_bic_score(struct dataframe *df, int x, int y, int *ypar,
@@ -28,9 +31,60 @@ double ges_discrete_bic_score(struct dataframe *df, int x, int y, int *ypar,
     xy[npar + 1] = y;
     for(int i = 0; i < npar; ++i)
         xy[i + 1] = ypar[i];
-    double score_plus  = discrete_bic_score(df, xy, npar + 1, args);
-    double score_minus = discrete_bic_score(df, xy + 1, npar, args);
-
+    double score_diff = discrete_bic_score_diff(df, xy, npar, args);
     free(xy);
-    return score_plus - score_minus + 1e-9;
+    return score_diff + 1e-9;
+}
+
+/* total_weight returns the number of observations N that df stands for */
+static double total_weight(struct dataframe *df)
+{
+    if (!df->weights)
+        return df->nobs;
+    double n = 0.0f;
+    for (int i = 0; i < df->nobs; ++i)
+        n += df->weights[i];
+    return n;
+}
+
+/*
+ * discrete_bic_penalty returns the penalty ges_discrete_bic_score charges for
+ * adding x to the n parents z of y: the penalty times log N times the number
+ * of parameters added, (|x| - 1)(|y| - 1) times the number of states of z.
+ */
+static double discrete_bic_penalty(struct dataframe *df, int x, int y, int *z,
+                                       int n, double penalty, double N)
+{
+    double params = (df->states[x] - 1.0f) * (df->states[y] - 1.0f);
+    for (int i = 0; i < n; ++i)
+        params *= df->states[z[i]];
+    return penalty * params * log(N);
+}
+
+/*
+ * ges_discrete_bic_lower_bound and ges_discrete_bic_upper_bound bound
+ * ges_discrete_bic_score for adding xp to the parents Z of y, over every Z
+ * with lo <= Z <= hi. The score is the penalty less twice the likelihood
+ * gain N I(x; y | Z), which is between 0 and N log min(|x|, |y|), and the
+ * penalty grows with the number of states of Z. The lower bound is loose, and
+ * rarely prunes a set T; bounding the gain by N H(y | lo) instead costs a
+ * count of the data per call and did not prune any more sets in tests.
+ */
+double ges_discrete_bic_lower_bound(struct ges_score *gs, int xp, int y,
+                                        int *lo, int n_lo)
+{
+    struct dataframe *df = gs->df;
+    double N          = total_weight(df);
+    int    min_states = df->states[xp] < df->states[y] ? df->states[xp] :
+                                                          df->states[y];
+    return discrete_bic_penalty(df, xp, y, lo, n_lo, gs->args->fargs[0], N) -
+               2.0f * N * log(min_states) - BOUND_SLACK;
+}
+
+double ges_discrete_bic_upper_bound(struct ges_score *gs, int xp, int y,
+                                        int *hi, int n_hi)
+{
+    struct dataframe *df = gs->df;
+    return discrete_bic_penalty(df, xp, y, hi, n_hi, gs->args->fargs[0],
+                                    total_weight(df)) + BOUND_SLACK;
 }
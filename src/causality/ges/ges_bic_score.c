@@ -93,7 +93,109 @@ double ges_bic_score(struct dataframe *df, int xp, int y, int *x, int nx,
     free(aug_cov_pxp);
     return calcluate_bic_diff(rss_p, rss_m, penalty, df->nobs);
 }
+/*
+ * lookup_covariance_xy stores the covariances between the nodes in x and the
+ * node y in cov, using the precalculated covariance matrix of df.
+ */
+static void lookup_covariance_xy(double *cov, struct dataframe *df, int *x,
+                                     int m, int y)
+{
+    double *cov_y = df->cov + (size_t) y * df->nvar;
+    for (int i = 0; i < m; ++i)
+        cov[i] = cov_y[x[i]];
+}
+
+/*
+ * bic_rss returns the rss of y regressed on the n nodes in z, and on xp as
+ * well if xp >= 0, from the covariances precalculated in gsm.
+ */
+static double bic_rss(struct ges_score_mem gsm, int xp, int *z, int n)
+{
+    double *aug_cov_mxp = malloc((n * (n + 2) + 1) * sizeof(double));
+    double *aug_cov_pxp = malloc((n + 1) * ((n + 1) + 2) * sizeof(double));
+    double  rss         = 1.0f;
+    if (aug_cov_mxp == NULL || aug_cov_pxp == NULL)
+        CAUSALITY_ERROR("Failed to allocate memory for BIC score\n");
+    else {
+        construct_aug_cov_mxp(aug_cov_mxp, gsm, z, n);
+        if (xp < 0)
+            rss = calculate_rss(aug_cov_mxp, n);
+        else {
+            construct_aug_cov_pxp(aug_cov_pxp, aug_cov_mxp, gsm, xp, z, n);
+            rss = calculate_rss(aug_cov_pxp, n + 1);
+        }
+    }
+    free(aug_cov_mxp);
+    free(aug_cov_pxp);
+    return rss;
+}
+
+/*
+ * ges_bic_lower_bound and ges_bic_upper_bound bound ges_bic_score for adding
+ * xp to the parents Z of y, over every Z with lo <= Z <= hi. Conditioning on
+ * more nodes never increases an rss, so rss_p(Z) >= rss_p(hi) and
+ * rss_m(Z) <= rss_m(lo), and the other way around, while the penalty of one
+ * more parent is the same for every Z.
+ */
+double ges_bic_lower_bound(struct ges_score *gs, int xp, int *lo, int n_lo,
+                               int *hi, int n_hi)
+{
+    double penalty = gs->args->fargs[0];
+    return calcluate_bic_diff(bic_rss(gs->gsm, xp, hi, n_hi),
+                                  bic_rss(gs->gsm, -1, lo, n_lo), penalty,
+                                  gs->df->nobs);
+}
+
+double ges_bic_upper_bound(struct ges_score *gs, int xp, int *lo, int n_lo,
+                               int *hi, int n_hi)
+{
+    double penalty = gs->args->fargs[0];
+    return calcluate_bic_diff(bic_rss(gs->gsm, xp, lo, n_lo),
+                                  bic_rss(gs->gsm, -1, hi, n_hi), penalty,
+                                  gs->df->nobs);
+}
 
+/*
+ * ges_bic_covariance_matrix precalculates the covariance matrix of df, so
+ * that the BIC optimizations only have to look up the covariances instead of
+ * recalculating them for every operator. The matrix is calculated by pairs of
+ * tiles of variables, a block of rows at a time, in parallel using nthreads
+ * threads. Returns nonzero on failure.
+ */
+int ges_bic_covariance_matrix(struct dataframe *df, int nthreads)
+{
+    int nvar = df->nvar;
+    int nobs = df->nobs;
+    if (df->cov)
+        return 0;
+    df->cov = calloc((size_t) nvar * nvar, sizeof(double));
+    if (!df->cov) {
+        CAUSALITY_ERROR("Failed to allocate memory for covariance matrix.\n");
+        return 1;
+    }
+    double **x       = (double **) df->df;
+    int      n_tiles = (nvar + PAIRWISE_TILE - 1) / PAIRWISE_TILE;
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+    for (int p = 0; p < n_tiles * (n_tiles + 1) / 2; ++p) {
+        int i0, i1, j0, j1;
+        tile_pair(p, n_tiles, nvar, &i0, &i1, &j0, &j1);
+        for (int start = 0; start < nobs; start += PAIRWISE_ROWS) {
+            int end = start + PAIRWISE_ROWS < nobs ? start + PAIRWISE_ROWS :
+                                                     nobs;
+            calc_cross_products_tile(df->cov, x, nvar, i0, i1, j0, j1, start,
+                                         end);
+        }
+    }
+    double inv_nm1 = 1.0f / (nobs - 1.0f);
+    for (int i = 0; i < nvar; ++i) {
+        df->cov[(size_t) i * nvar + i] = 1.0f;
+        for (int j = i + 1; j < nvar; ++j) {
+            df->cov[(size_t) i * nvar + j] *= inv_nm1;
+            df->cov[(size_t) j * nvar + i]  = df->cov[(size_t) i * nvar + j];
+        }
+    }
+    return 0;
+}
 
 void ges_bic_optimization1(struct cgraph *cg, int y, int n, struct ges_score *gs)
 {
@@ -107,26 +209,36 @@ void ges_bic_optimization1(struct cgraph *cg, int y, int n, struct ges_score *gs
     gsm.cov_xpx = malloc(gsm.m * sizeof(double));
     /* lbls stores the covariance matrix's column/row names */
     gsm.lbls    = malloc(gsm.m * sizeof(int));
-    /* grab datafame and number of observations */
-    int nobs = gs->df->nobs;
-    double **df = (double **) gs->df->df;
-    double **x  = malloc(gsm.m * sizeof(double *));
-    /* fill in x */
     int i = 0;
     while (p) {
-        gsm.lbls[i] = p->node;
-        x[i++]      = df[p->node];
-        p           = p->next;
+        gsm.lbls[i++] = p->node;
+        p             = p->next;
     }
     while (s) {
-        gsm.lbls[i] = s->node;
-        x[i++]      = df[s->node];
-        s           = s->next;
+        gsm.lbls[i++] = s->node;
+        s             = s->next;
+    }
+    struct dataframe *data = gs->df;
+    if (data->cov) {
+        memcpy(gsm.cov_xy, data->cov + (size_t) y * data->nvar,
+                   n * sizeof(double));
+        for (int j = 0; j < gsm.m; ++j)
+            lookup_covariance_xy(gsm.cov_xx + j * gsm.m, data, gsm.lbls,
+                                     gsm.m, gsm.lbls[j]);
+    }
+    else {
+        /* grab datafame and number of observations */
+        int nobs = data->nobs;
+        double **df = (double **) data->df;
+        double **x  = malloc(gsm.m * sizeof(double *));
+        /* fill in x */
+        for (int j = 0; j < gsm.m; ++j)
+            x[j] = df[gsm.lbls[j]];
+        calc_covariance_xy(gsm.cov_xy, df, df[y], nobs, n);
+        calc_covariance_matrix(gsm.cov_xx, x, nobs, gsm.m);
+        free(x);
     }
-    calc_covariance_xy(gsm.cov_xy, df, df[y], nobs, n);
-    calc_covariance_matrix(gsm.cov_xx, x, nobs, gsm.m);
     gs->gsm = gsm;
-    free(x);
 }
 
 void ges_bic_optimization2(int xp, struct ges_score *gs)
@@ -134,8 +246,128 @@ void ges_bic_optimization2(int xp, struct ges_score *gs)
     double **df   = (double **) gs->df->df;
     int      nobs = gs->df->nobs;
     struct ges_score_mem gsm = gs->gsm;
+    if (gs->df->cov) {
+        lookup_covariance_xy(gsm.cov_xpx, gs->df, gsm.lbls, gsm.m, xp);
+        return;
+    }
     double *x[gsm.m];
     for (int i = 0; i < gsm.m; ++i)
         x[i] = df[gsm.lbls[i]];
     calc_covariance_xy(gs->gsm.cov_xpx, x, df[xp], nobs, gsm.m);
 }
+
+/*
+ * ges_bic_optimization_subset is ges_bic_optimization1 for the operators
+ * x --> y, where x is in nodes. Instead of calculating the covariance between
+ * y and every node, only the covariances between y and nodes and between y
+ * and its parents and neighbors are calculated.
+ */
+void ges_bic_optimization_subset(struct cgraph *cg, int y, int *nodes, int n,
+                                     struct ges_score *gs)
+{
+    ges_bic_optimization1(cg, y, 0, gs);
+    struct ges_score_mem gsm = gs->gsm;
+    double **df   = (double **) gs->df->df;
+    int      nobs = gs->df->nobs;
+    int      m    = gsm.m + n;
+    free(gsm.cov_xy);
+    gsm.cov_xy  = malloc(gs->df->nvar * sizeof(double));
+    if (gs->df->cov) {
+        double *cov_y = gs->df->cov + (size_t) y * gs->df->nvar;
+        for (int i = 0; i < gsm.m; ++i)
+            gsm.cov_xy[gsm.lbls[i]] = cov_y[gsm.lbls[i]];
+        for (int i = 0; i < n; ++i)
+            gsm.cov_xy[nodes[i]] = cov_y[nodes[i]];
+        gs->gsm = gsm;
+        return;
+    }
+    double **x  = malloc(m * sizeof(double *));
+    double  *cov = malloc(m * sizeof(double));
+    for (int i = 0; i < gsm.m; ++i)
+        x[i] = df[gsm.lbls[i]];
+    for (int i = 0; i < n; ++i)
+        x[gsm.m + i] = df[nodes[i]];
+    calc_covariance_xy(cov, x, df[y], nobs, m);
+    for (int i = 0; i < gsm.m; ++i)
+        gsm.cov_xy[gsm.lbls[i]] = cov[i];
+    for (int i = 0; i < n; ++i)
+        gsm.cov_xy[nodes[i]] = cov[gsm.m + i];
+    gs->gsm = gsm;
+    free(x);
+    free(cov);
+}
+
+/*
+ * ges_bic_optimization_pair precalculates the covariances needed to score the
+ * single operator xp --> y.
+ */
+void ges_bic_optimization_pair(struct cgraph *cg, int xp, int y,
+                                   struct ges_score *gs)
+{
+    ges_bic_optimization_subset(cg, y, &xp, 1, gs);
+    ges_bic_optimization2(xp, gs);
+}
+
+/*
+ * ges_bic_score_batch scores the operators x --> y, for the n nodes x in xs,
+ * that only condition on the parents and neighbors of y in gs->gsm, as when
+ * nayx and T are empty, and stores the score differences in score_diffs. The
+ * covariance matrix of the parents is factored once, and the candidates are
+ * solved against it together. Returns nonzero if that fails, in which case
+ * the operators have to be scored one at a time.
+ */
+int ges_bic_score_batch(struct ges_score *gs, int y, int *xs, int n,
+                            double *score_diffs)
+{
+    struct ges_score_mem gsm  = gs->gsm;
+    struct dataframe    *data = gs->df;
+    double penalty = gs->args->fargs[0];
+    int    m       = gsm.m;
+    int    err     = 1;
+    double *chol       = malloc((m * m + 1) * sizeof(double));
+    double *cov_zy     = malloc((m + 1) * sizeof(double));
+    double *v          = malloc(((size_t) m * n + 1) * sizeof(double));
+    double *cov_xy     = malloc((n + 1) * sizeof(double));
+    double *reductions = malloc((n + 1) * sizeof(double));
+    if (!chol || !cov_zy || !v || !cov_xy || !reductions)
+        goto CLEANUP;
+    memcpy(chol, gsm.cov_xx, m * m * sizeof(double));
+    if (calc_cholesky_decomposition(chol, m))
+        goto CLEANUP;
+    for (int i = 0; i < m; ++i)
+        cov_zy[i] = gsm.cov_xy[gsm.lbls[i]];
+    for (int c = 0; c < n; ++c)
+        cov_xy[c] = gsm.cov_xy[xs[c]];
+    if (data->cov) {
+        for (int i = 0; i < m; ++i) {
+            double *cov_i = data->cov + (size_t) gsm.lbls[i] * data->nvar;
+            for (int c = 0; c < n; ++c)
+                v[(size_t) i * n + c] = cov_i[xs[c]];
+        }
+    }
+    else {
+        double **df = (double **) data->df;
+        double  *z[m + 1];
+        double   cov_zx[m + 1];
+        for (int i = 0; i < m; ++i)
+            z[i] = df[gsm.lbls[i]];
+        for (int c = 0; c < n; ++c) {
+            calc_covariance_xy(cov_zx, z, df[xs[c]], data->nobs, m);
+            for (int i = 0; i < m; ++i)
+                v[(size_t) i * n + c] = cov_zx[i];
+        }
+    }
+    double rss_m = calc_rss_reductions(reductions, v, cov_zy, cov_xy, chol, m,
+                                           n);
+    for (int c = 0; c < n; ++c)
+        score_diffs[c] = calcluate_bic_diff(rss_m - reductions[c], rss_m,
+                                                penalty, data->nobs);
+    err = 0;
+    CLEANUP:
+    free(chol);
+    free(cov_zy);
+    free(v);
+    free(cov_xy);
+    free(reductions);
+    return err;
+}
@@ -5,6 +5,7 @@
 #include <cgraph/cgraph.h>
 #include <scores/scores.h>
 #include <dataframe.h>
+#include <algorithms/meek.h>
 #include <ges/ges.h>
 
 struct ges_operator {
@@ -23,6 +24,70 @@ struct ges_operator {
     double score_diff;
 }; /* 64 bytes */
 
+/*
+ * tail_paths records the semi-directed paths y ~~> x of an insertion operator
+ * that avoid nayx, cut at the nodes of S in stops (the nodes that may be in
+ * T): whether a path from y reaches x without passing a stop, which stops it
+ * reaches first, which stops reach x without passing another stop, and which
+ * stops each stop reaches first. Adding x --> y creates a cycle exactly when
+ * these paths connect y to x through stops outside of T.
+ */
+struct tail_paths {
+    int      y_to_x;
+    uint64_t stops;
+    uint64_t from_y;
+    uint64_t to_x;
+    uint64_t from_stop[64];
+};
+
+/*
+ * ges_entry is a scored insertion operator x --> y stored in the operator
+ * table. t is the best tail set found for the operator, as a bitmask over the
+ * neighbors of y that are not adjacent to x (which partition_neighbors sorts
+ * in ascending order).
+ */
+struct ges_entry {
+    int      x;
+    uint64_t t;
+    double   score_diff;
+};
+
+struct ges_row {
+    struct ges_entry *entries;
+    int               size;
+    int               capacity;
+};
+
+/* ges_table stores the scored insertion operators into each node y */
+struct ges_table {
+    struct ges_row *rows;
+    int             n_nodes;
+};
+
+/*
+ * ges_candidates stores, for each node y, the nodes x for which insertion
+ * operators x --> y are considered by FES. The candidates of y are stored in
+ * ascending order in nodes[offsets[y]] ... nodes[offsets[y + 1] - 1].
+ */
+struct ges_candidates {
+    int *offsets;
+    int *nodes;
+    int  n_nodes;
+};
+
+/*
+ * reorient_mem holds the preallocated memory used by reorient. marked is a
+ * sparse set: the nodes with parents tagged compelled are exactly the first
+ * n_marked entries of touched, so only those entries need to be cleared.
+ */
+struct reorient_mem {
+    struct worklist wl;
+    unsigned char  *marked;
+    int            *touched;
+    int            *buf;
+    int             n_marked;
+};
+
 struct ges_heap {
     int     max_size;
     int     size;
@@ -31,6 +96,33 @@ struct ges_heap {
     struct ges_operator  *ops;
     struct ges_operator **ops_ptrs;
 };
+/*
+ * ges_search holds the state of a search: the graph, the operator into each
+ * node and the heap that orders the operators, and the table of scored
+ * insertion operators. ccf_ges discards it once the search is done, while a
+ * ges_session keeps it between batches of data. marks is only used by
+ * sessions, to record the nodes whose rows of the table are out of date.
+ */
+struct ges_search {
+    struct ges_score       score;
+    struct score_args      args;  /* score.args, with the search's cache */
+    struct ges_subset_counts subsets; /* counted through score.subsets */
+    struct ges_settings   *settings;
+    struct cgraph         *cg;
+    struct ges_operator   *ops;
+    struct ges_heap       *heap;
+    struct ges_table      *tbl;
+    struct ges_candidates *cand;
+    struct reorient_mem    reorient_mem;
+    int                   *cycle_test_mem;
+    int                   *nodes;
+    unsigned char         *row_marks;
+    unsigned char         *marks; /* NULL, or GES_STALE_* flags per node */
+};
+
+#define GES_STALE_TABLE 1 /* BES changed the graph around the node      */
+#define GES_STALE_PROBE 2 /* FES rescored the node with different parents */
+
 /*
 struct ges_operator {
     int    xp;
@@ -63,27 +155,111 @@ static inline int IS_HEAD_NODE(uint64_t h, int node)
     return (h & i) == i;
 }
 
+/*
+ * Without candidate screening, FES STEP 0 scores almost every pair of nodes,
+ * so the pairwise statistics it needs (the covariance matrix for BIC, the
+ * contingency tables of each pair for the discrete scores) are calculated in
+ * bulk: by pairs of tiles of PAIRWISE_TILE nodes, PAIRWISE_ROWS rows at a
+ * time, so that the rows of both tiles stay in cache. This is only done for
+ * at most PAIRWISE_MAX_NODES nodes, as it uses nvar x nvar doubles.
+ */
+#define PAIRWISE_TILE      64
+#define PAIRWISE_ROWS      512
+#define PAIRWISE_MAX_NODES 4096
+
+/*
+ * tile_pair stores the ranges of nodes [i0, i1) and [j0, j1) of the p-th pair
+ * of tiles I <= J, of the n_tiles tiles of n nodes.
+ */
+static inline void tile_pair(int p, int n_tiles, int n, int *i0, int *i1,
+                                 int *j0, int *j1)
+{
+    int i = 0;
+    while (p >= n_tiles - i) {
+        p -= n_tiles - i;
+        i++;
+    }
+    int j = i + p;
+    *i0 = i * PAIRWISE_TILE;
+    *i1 = *i0 + PAIRWISE_TILE < n ? *i0 + PAIRWISE_TILE : n;
+    *j0 = j * PAIRWISE_TILE;
+    *j1 = *j0 + PAIRWISE_TILE < n ? *j0 + PAIRWISE_TILE : n;
+}
+
 /* memory utility functions */
 void free_ges_score_mem(struct ges_score_mem gsm);
 /* functions that deterimine whether or not a operators is legal */
 int  valid_fes_clique(struct cgraph *cg, struct ges_operator *op);
 int  valid_bes_clique(struct cgraph *cg, struct ges_operator *op);
+void adjacency_masks(struct cgraph *cg, int *nodes, int n, uint64_t *adj);
+int  is_clique_mask(uint64_t set, uint64_t *adj, int n);
 int  cycle_created(struct cgraph *cg, struct ges_operator *op, int *mem);
+void find_tail_paths(struct cgraph *cg, struct ges_operator *op, uint64_t stops,
+                        int *mem, struct tail_paths *paths);
+int  tail_creates_cycle(struct tail_paths *paths, uint64_t t);
 /* misc utility functions */
+void sort_nodes(int *nodes, int n);
 void partition_neighbors(struct cgraph *cg, struct ges_operator *op);
 void calculate_nayx(struct cgraph *cg, struct ges_operator *op);
 void calculate_parents(struct cgraph *cg, struct ges_operator *op);
 /* reorient cgraph after an operator has been applied */
-void reorient(struct cgraph *cg, int *nodes, int n, int *visited);
-int get_deletion_operators_to_update(int *nodes, struct cgraph *cpy,
-                                         struct cgraph *cg, struct ges_operator
-                                         *op, int *visited);
-int get_insertion_operators_to_update(int *nodes, struct cgraph *cpy,
-                                          struct cgraph *cg, struct ges_operator
-                                          *op, int *visited);
+int  create_reorient_mem(struct reorient_mem *mem, int n_nodes);
+void free_reorient_mem(struct reorient_mem *mem);
+void reorient(struct cgraph *cg, int *nodes, int n, struct reorient_mem *mem);
+int  get_operators_to_update(int *nodes, struct cgraph *cg);
 /* functions that optimize ges_bic_score score */
 void ges_bic_optimization1(struct cgraph *cg, int y, int n, struct ges_score *gs);
 void ges_bic_optimization2(int xp, struct ges_score *gs);
+void ges_bic_optimization_subset(struct cgraph *cg, int y, int *nodes, int n,
+                                     struct ges_score *gs);
+void ges_bic_optimization_pair(struct cgraph *cg, int xp, int y,
+                                   struct ges_score *gs);
+int  ges_bic_score_batch(struct ges_score *gs, int y, int *xs, int n,
+                            double *score_diffs);
+int  ges_bic_covariance_matrix(struct dataframe *df, int nthreads);
+/* bounds on the score of adding xp to the parents Z of y, for lo <= Z <= hi */
+double ges_bic_lower_bound(struct ges_score *gs, int xp, int *lo, int n_lo,
+                               int *hi, int n_hi);
+double ges_bic_upper_bound(struct ges_score *gs, int xp, int *lo, int n_lo,
+                               int *hi, int n_hi);
+double ges_discrete_bic_lower_bound(struct ges_score *gs, int xp, int y,
+                                        int *lo, int n_lo);
+double ges_discrete_bic_upper_bound(struct ges_score *gs, int xp, int y,
+                                        int *hi, int n_hi);
+/* the phases of ccf_ges, which ges_session runs again for every batch */
+int  init_ges_search(struct ges_search *s, struct ges_score score,
+                         struct cgraph *cg, struct ges_settings *settings);
+void free_ges_search(struct ges_search *s);
+void ges_step0(struct ges_search *s, struct ges_stats *stats);
+double ges_subset_pruning(struct ges_search *s);
+int  step0_parents(struct cgraph *cg, int y, struct ges_candidates *cand,
+                       struct ges_settings *settings, int *xs);
+double * ges_pairwise_score_diffs(struct ges_search *s, int nthreads);
+void select_insertion_operators(struct ges_search *s);
+double ges_forward_search(struct ges_search *s);
+double ges_backward_search(struct ges_search *s);
+void orient_with_knowledge(struct cgraph *cg, struct ges_knowledge *know);
+void update_insertion_row(struct cgraph *cg, struct ges_table *tbl, int y,
+                              struct ges_candidates *cand,
+                              struct ges_settings *settings,
+                              struct ges_score gs, int *cycle_test_mem);
+void apply_optimization1(struct cgraph *cg, int y, int n, struct ges_score *gs);
+void apply_optimization2(struct cgraph *cg, int x, struct ges_score *gs);
+/* ges_table functions */
+struct ges_table * create_ges_table(int n_nodes);
+void free_ges_table(struct ges_table *tbl);
+void clear_table_row(struct ges_table *tbl, int y);
+void remove_table_entry(struct ges_table *tbl, int x, int y);
+void set_table_entry(struct ges_table *tbl, int x, int y, uint64_t t,
+                         double score_diff);
+struct ges_entry * best_table_entry(struct ges_table *tbl, int y);
+struct ges_candidates * effect_edges_from_table(struct ges_table *tbl);
+void sort_ges_candidates(struct ges_candidates *cand);
+void free_ges_candidates(struct ges_candidates *cand);
+int  is_candidate(struct ges_candidates *cand, int x, int y);
+struct ges_candidates * screen_candidates(struct cgraph *cg,
+                                              struct ges_score gs, int k,
+                                              int statistic, int nthreads);
 /* ges_heap functions */
 void free_heap(struct ges_heap *hp);
 void build_heap(struct ges_heap *hp);
@@ -0,0 +1,98 @@
+/*
+ * ges_knowledge.c implements the background knowledge used to prune the
+ * search space of GES. An operator that would add a forbidden edge, or delete
+ * a required one, is rejected before it is scored. Forbidden and required
+ * edges are stored as bitsets so the checks in the inner loops of GES are a
+ * few instructions.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <causality.h>
+#include <ges/ges.h>
+
+#define WORD_BITS 64
+
+struct ges_knowledge * create_ges_knowledge(int n_nodes)
+{
+    struct ges_knowledge *know = calloc(1, sizeof(struct ges_knowledge));
+    if (!know)
+        goto ERR;
+    know->n_nodes   = n_nodes;
+    know->n_words   = (n_nodes + WORD_BITS - 1) / WORD_BITS;
+    size_t size     = (size_t) n_nodes * know->n_words + 1;
+    know->forbidden = calloc(size, sizeof(uint64_t));
+    know->required  = calloc(size, sizeof(uint64_t));
+    if (!know->forbidden || !know->required) {
+        free_ges_knowledge(know);
+        goto ERR;
+    }
+    return know;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for GES knowledge.\n");
+    return NULL;
+}
+
+void free_ges_knowledge(struct ges_knowledge *know)
+{
+    free(know->tiers);
+    free(know->forbidden);
+    free(know->required);
+    free(know);
+}
+
+/* set_ges_tiers copies tiers, the tier of each node, into know */
+int set_ges_tiers(struct ges_knowledge *know, int *tiers)
+{
+    free(know->tiers);
+    know->tiers = malloc(know->n_nodes * sizeof(int));
+    if (!know->tiers) {
+        CAUSALITY_ERROR("Failed to allocate memory for GES knowledge.\n");
+        return 1;
+    }
+    memcpy(know->tiers, tiers, know->n_nodes * sizeof(int));
+    return 0;
+}
+
+static void set_bit(uint64_t *bits, int n_words, int x, int y)
+{
+    bits[(size_t) x * n_words + y / WORD_BITS] |= (uint64_t) 1 << (y % WORD_BITS);
+}
+
+static int get_bit(uint64_t *bits, int n_words, int x, int y)
+{
+    return (bits[(size_t) x * n_words + y / WORD_BITS] >> (y % WORD_BITS)) & 1;
+}
+
+void forbid_ges_edge(struct ges_knowledge *know, int x, int y)
+{
+    set_bit(know->forbidden, know->n_words, x, y);
+}
+
+void require_ges_edge(struct ges_knowledge *know, int x, int y)
+{
+    set_bit(know->required, know->n_words, x, y);
+}
+
+/*
+ * ges_edge_forbidden returns whether or not the edge x --> y is forbidden,
+ * either explicitly or because x is in a later tier than y. If know is NULL,
+ * nothing is forbidden.
+ */
+int ges_edge_forbidden(struct ges_knowledge *know, int x, int y)
+{
+    if (!know)
+        return 0;
+    if (know->tiers && know->tiers[x] > know->tiers[y])
+        return 1;
+    return get_bit(know->forbidden, know->n_words, x, y);
+}
+
+/* ges_edge_required returns whether or not the edge x --> y is required */
+int ges_edge_required(struct ges_knowledge *know, int x, int y)
+{
+    if (!know)
+        return 0;
+    return get_bit(know->required, know->n_words, x, y);
+}
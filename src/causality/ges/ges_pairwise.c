@@ -0,0 +1,154 @@
+/*
+ * ges_pairwise.c scores the operators x --> y of FES STEP 0 for the discrete
+ * scores in bulk. Scoring them one at a time reads the columns of x and y
+ * from memory for every pair. Instead, the nodes are split into tiles, and
+ * for each pair of tiles the contingency tables of all the pairs between
+ * them are counted a block of rows at a time, while the rows of both tiles
+ * stay in cache. Each table then scores both directions of its pair.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <causality.h>
+#include <dataframe.h>
+#include <scores/scores.h>
+#include <ges/ges.h>
+#include <ges/ges_internal.h>
+
+static double pair_score_diff(struct ges_score score, int x, int y, int *n_xy)
+{
+    if (score.gsf == ges_bdeu_score)
+        return bdeu_pair_score_diff(score.df, x, y, n_xy, score.args);
+    /* ges_discrete_bic_score adds the same offset */
+    return discrete_bic_pair_score_diff(score.df, x, y, n_xy, score.args) +
+               1e-9;
+}
+
+/*
+ * score_tile_pair scores the operators between the nodes [i0, i1) and
+ * [j0, j1) that are marked in need into diffs. need and diffs are indexed by
+ * y * nvar + x.
+ */
+static void score_tile_pair(struct ges_score score, int i0, int i1, int j0,
+                                int j1, unsigned char *need, double *diffs)
+{
+    struct dataframe *df   = score.df;
+    size_t            nvar = df->nvar;
+    int pi[PAIRWISE_TILE * PAIRWISE_TILE];
+    int pj[PAIRWISE_TILE * PAIRWISE_TILE];
+    int offsets[PAIRWISE_TILE * PAIRWISE_TILE];
+    int n_pairs = 0;
+    int size    = 0;
+    int max_size = 0;
+    for (int i = i0; i < i1; ++i) {
+        for (int j = j0 > i + 1 ? j0 : i + 1; j < j1; ++j) {
+            if (!need[j * nvar + i] && !need[i * nvar + j])
+                continue;
+            int cells = df->states[i] * df->states[j];
+            pi[n_pairs]      = i;
+            pj[n_pairs]      = j;
+            offsets[n_pairs] = size;
+            size            += cells;
+            max_size         = cells > max_size ? cells : max_size;
+            n_pairs++;
+        }
+    }
+    if (!n_pairs)
+        return;
+    int *tables     = calloc(size, sizeof(int));
+    int *transposed = malloc(max_size * sizeof(int));
+    if (!tables || !transposed) {
+        /* fall back to scoring the pairs one at a time */
+        for (int p = 0; p < n_pairs; ++p) {
+            int i = pi[p], j = pj[p];
+            if (need[j * nvar + i])
+                diffs[j * nvar + i] = score.gsf(df, i, j, NULL, 0, score.args,
+                                                    score.gsm);
+            if (need[i * nvar + j])
+                diffs[i * nvar + j] = score.gsf(df, j, i, NULL, 0, score.args,
+                                                    score.gsm);
+        }
+        goto CLEANUP;
+    }
+    for (int start = 0; start < df->nobs; start += PAIRWISE_ROWS) {
+        int end = start + PAIRWISE_ROWS < df->nobs ? start + PAIRWISE_ROWS :
+                                                     df->nobs;
+        for (int p = 0; p < n_pairs; ++p) {
+            int *x_i   = df->df[pi[p]];
+            int *x_j   = df->df[pj[p]];
+            int  n_j   = df->states[pj[p]];
+            int *table = tables + offsets[p];
+            if (df->weights) {
+                for (int k = start; k < end; ++k)
+                    table[x_i[k] * n_j + x_j[k]] += df->weights[k];
+            }
+            else {
+                for (int k = start; k < end; ++k)
+                    table[x_i[k] * n_j + x_j[k]]++;
+            }
+        }
+    }
+    for (int p = 0; p < n_pairs; ++p) {
+        int  i     = pi[p], j = pj[p];
+        int  n_i   = df->states[i];
+        int  n_j   = df->states[j];
+        int *table = tables + offsets[p];
+        if (need[j * nvar + i])
+            diffs[j * nvar + i] = pair_score_diff(score, i, j, table);
+        if (need[i * nvar + j]) {
+            for (int a = 0; a < n_i; ++a) {
+                for (int b = 0; b < n_j; ++b)
+                    transposed[b * n_i + a] = table[a * n_j + b];
+            }
+            diffs[i * nvar + j] = pair_score_diff(score, j, i, transposed);
+        }
+    }
+    CLEANUP:
+    free(tables);
+    free(transposed);
+}
+
+/*
+ * ges_pairwise_score_diffs scores the operators x --> y that FES STEP 0
+ * scores into the nodes y with no adjacents (see step0_parents), using
+ * nthreads threads. Returns the nvar x nvar matrix of the score differences,
+ * indexed by y * nvar + x, or NULL if the operators should be scored one at a
+ * time instead.
+ */
+double * ges_pairwise_score_diffs(struct ges_search *s, int nthreads)
+{
+    struct ges_score score = s->score;
+    struct cgraph   *cg    = s->cg;
+    int              nvar  = cg->n_nodes;
+    if (s->cand || nvar > PAIRWISE_MAX_NODES)
+        return NULL;
+    if (score.gsf != ges_bdeu_score && score.gsf != ges_discrete_bic_score)
+        return NULL;
+    unsigned char *need  = calloc((size_t) nvar * nvar, 1);
+    double        *diffs = malloc((size_t) nvar * nvar * sizeof(double));
+    int           *xs    = malloc(nvar * sizeof(int));
+    if (!need || !diffs || !xs) {
+        free(need);
+        free(diffs);
+        free(xs);
+        return NULL;
+    }
+    for (int y = 0; y < nvar; ++y) {
+        if (cg->parents[y] || cg->spouses[y] || cg->children[y])
+            continue;
+        int n_x = step0_parents(cg, y, NULL, s->settings, xs);
+        for (int i = 0; i < n_x; ++i)
+            need[(size_t) y * nvar + xs[i]] = 1;
+    }
+    free(xs);
+    int n_tiles = (nvar + PAIRWISE_TILE - 1) / PAIRWISE_TILE;
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+    for (int p = 0; p < n_tiles * (n_tiles + 1) / 2; ++p) {
+        int i0, i1, j0, j1;
+        tile_pair(p, n_tiles, nvar, &i0, &i1, &j0, &j1);
+        score_tile_pair(score, i0, i1, j0, j1, need, diffs);
+    }
+    free(need);
+    return diffs;
+}
@@ -0,0 +1,68 @@
+/*
+ * ges_path.c implements the penalty path of GES: the BIC score is run for a
+ * sequence of penalties. The covariance matrix of the dataset is calculated
+ * once and shared by every run, and the runs are spread over the threads.
+ * Each run starts from the same graph, so every graph on the path is the one
+ * a separate call to ccf_ges with that penalty would learn; warm starting
+ * from a neighbouring penalty is faster, but can land in a different local
+ * optimum.
+ */
+
+#include <stdlib.h>
+
+#include <causality.h>
+#include <dataframe.h>
+
+#include <cgraph/cgraph.h>
+#include <ges/ges.h>
+#include <ges/ges_internal.h>
+
+/*
+ * ccf_ges_path runs GES with the BIC score for each of the n_penalties
+ * penalties in penalties, starting from the graph cg, which is left
+ * unchanged. The graph learned with penalties[k] is stored in cgs[k], and its
+ * score relative to cg (plus any required edges) is stored in scores[k]. If
+ * settings asks for more than one thread, the penalties are run in parallel.
+ * The covariance matrix of score.df is calculated if it is not already
+ * present, and is freed along with the dataframe. Returns nonzero on failure.
+ */
+int ccf_ges_path(struct ges_score score, double *penalties, int n_penalties,
+                     struct cgraph *cg, struct ges_settings *settings,
+                     struct cgraph **cgs, double *scores)
+{
+    struct ges_settings defaults = {.nthreads = 1,
+                                    .screening = SCREEN_CORRELATION};
+    if (!settings)
+        settings = &defaults;
+    if (n_penalties < 1)
+        return 0;
+    if (score.gsf != ges_bic_score) {
+        CAUSALITY_ERROR("The GES penalty path requires the BIC score.\n");
+        return 1;
+    }
+    int nthreads = settings->nthreads > 0 ? settings->nthreads : 1;
+    int nprocs   = nthreads < n_penalties ? nthreads : n_penalties;
+    if (ges_bic_covariance_matrix(score.df, nthreads))
+        return 1;
+    /* each run gets one thread if the path itself is run in parallel */
+    struct ges_settings run_settings = *settings;
+    run_settings.nthreads = nprocs > 1 ? 1 : nthreads;
+    for (int k = 0; k < n_penalties; ++k) {
+        if ((cgs[k] = copy_cgraph(cg)) == NULL) {
+            CAUSALITY_ERROR("Failed to allocate memory for GES penalty path.\n");
+            while (k--)
+                free_cgraph(cgs[k]);
+            return 1;
+        }
+    }
+    int *iargs = score.args ? score.args->iargs : NULL;
+    #pragma omp parallel for num_threads(nprocs) schedule(dynamic, 1)
+    for (int k = 0; k < n_penalties; ++k) {
+        double penalty = penalties[k];
+        struct score_args args = {.fargs = &penalty, .iargs = iargs};
+        struct ges_score  run  = score;
+        run.args  = &args;
+        scores[k] = ccf_ges(run, cgs[k], &run_settings, NULL);
+    }
+    return 0;
+}
@@ -12,106 +12,133 @@
 #define TAG_COMPELLED  1
 #define TAG_REVERSABLE UNTAGGED
 
-/* compelled edge list */
-struct cel {
-    struct edge_list *p;
-    struct cel *next;
-};
+int create_reorient_mem(struct reorient_mem *mem, int n_nodes)
+{
+    memset(mem, 0, sizeof(struct reorient_mem));
+    mem->marked  = calloc(n_nodes, sizeof(unsigned char));
+    mem->touched = malloc(n_nodes * sizeof(int));
+    mem->buf     = malloc(n_nodes * sizeof(int));
+    if (!mem->marked || !mem->touched || !mem->buf)
+        goto ERR;
+    if (create_worklist(&mem->wl, n_nodes))
+        goto ERR;
+    return 0;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for reorient.\n");
+    free_reorient_mem(mem);
+    return 1;
+}
+
+void free_reorient_mem(struct reorient_mem *mem)
+{
+    free(mem->marked);
+    free(mem->touched);
+    free(mem->buf);
+    free_worklist(&mem->wl);
+    memset(mem, 0, sizeof(struct reorient_mem));
+}
 
-static void make_compelled(struct cel **compelled, struct edge_list *l)
+/*
+ * make_compelled tags the edge l, which is in the parent list of y, as
+ * compelled. The first time one of the parents of y is tagged, y is recorded
+ * in touched so the tags can be cleared once reorient is done.
+ */
+static void make_compelled(struct reorient_mem *mem, int y,
+                               struct edge_list *l)
 {
     l->tag = TAG_COMPELLED;
-    struct cel *t = malloc(sizeof(struct cel));
-    t->p    = l;
-    t->next = NULL;
-    if (*compelled)
-        t->next = *compelled;
-    *compelled = t;
+    if (!mem->marked[y]) {
+        mem->marked[y] = 1;
+        mem->touched[mem->n_marked++] = y;
+    }
 }
 
-static void free_compelled(struct cel *compelled)
+/*
+ * free_compelled untags every compelled edge found during reorientation, and
+ * clears the marked nodes.
+ */
+static void free_compelled(struct cgraph *cg, struct reorient_mem *mem)
 {
-    struct cel *next;
-    while (compelled) {
-        compelled->p->tag = UNTAGGED;
-        next = compelled->next;
-        free(compelled);
-        compelled = next;
+    for (int i = 0; i < mem->n_marked; ++i) {
+        int node = mem->touched[i];
+        struct edge_list *p = cg->parents[node];
+        while (p) {
+            p->tag = UNTAGGED;
+            p      = p->next;
+        }
+        mem->marked[node] = 0;
     }
+    mem->n_marked = 0;
 }
 
 /*
  * orient takes the undirected edge x --- y and orients it x --> y. The edge is
- * tagged compelled and added to the compelled list. We have made a change to x
- * and y so we mark them down as visited. y is added to the stack to see what
- * effect the newly oriented edge has.
+ * tagged compelled. Both x and y are added to the worklist to see what effect
+ * the newly oriented edge has.
  */
-static void orient(struct cgraph *cg, int x, int y, struct stack **s,
-                       struct cel **compelled, int *visited)
+static void orient(struct cgraph *cg, int x, int y, struct reorient_mem *mem)
 {
     orient_undirected_edge(cg, x, y);
     /* get the newly created edge and make it compelled */
-    make_compelled(compelled, search_edge_list(cg->parents[y], x));
-    visited[x] = 1;
-    visited[y] = 1;
-    push(s, y);
+    make_compelled(mem, y, search_edge_list(cg->parents[y], x));
+    enqueue_node(&mem->wl, x);
+    enqueue_node(&mem->wl, y);
 }
 
-static void apply_rule_locally(struct cgraph *cg, int x, struct stack **s,
-                                   struct cel **compelled, int *visited,
-                                   meek_rule meek_rule)
+/*
+ * meek_rules applies the meek rules to the undirected edges of x. Orientation
+ * occurs in place, so instead of copying the spouses of x we take a snapshot
+ * of them in mem->buf and drop edges from the snapshot as they are oriented.
+ */
+static void meek_rules(struct cgraph *cg, int x, struct reorient_mem *mem)
 {
-    /*
-     * we need to create a copy of spouses in case an edge is
-     * oriented -- orientation occurs "in place."
-     */
-    struct edge_list *cpy = copy_edge_list(cg->spouses[x]);
-    struct edge_list *p   = cpy;
+    static const meek_rule rules[NUM_MEEK_RULES] = {meek_rule1, meek_rule2,
+                                                        meek_rule3, meek_rule4};
+    int *spouses = mem->buf;
+    int  n       = 0;
+    struct edge_list *p = cg->spouses[x];
     while (p) {
-        int y = p->node;
-        if (meek_rule(cg, x, y))
-            orient(cg, x, y, s, compelled, visited);
-        else if (meek_rule(cg, y, x))
-            orient(cg, y, x, s, compelled, visited);
+        spouses[n++] = p->node;
         p = p->next;
     }
-    free_edge_list(cpy);
-}
-
-static void meek_rules(struct cgraph *cg, int x, struct stack **s,
-                           struct cel **compelled, int *visited)
-{
-    apply_rule_locally(cg, x, s, compelled, visited, meek_rule1);
-    apply_rule_locally(cg, x, s, compelled, visited, meek_rule2);
-    apply_rule_locally(cg, x, s, compelled, visited, meek_rule3);
-    apply_rule_locally(cg, x, s, compelled, visited, meek_rule4);
+    for (int i = 0; i < NUM_MEEK_RULES && n > 0; ++i) {
+        int k = 0;
+        for (int j = 0; j < n; ++j) {
+            int y = spouses[j];
+            if (rules[i](cg, x, y))
+                orient(cg, x, y, mem);
+            else if (rules[i](cg, y, x))
+                orient(cg, y, x, mem);
+            else
+                spouses[k++] = y;
+        }
+        n = k;
+    }
 }
 
-static void push_list(struct stack **s, struct edge_list *p)
+static void enqueue_list(struct worklist *wl, struct edge_list *p)
 {
     while (p) {
-        push(s, p->node);
+        enqueue_node(wl, p->node);
         p = p->next;
     }
 }
 
-static void push_adjacents(int node, struct cgraph *cg, struct stack **s)
+static void enqueue_adjacents(int node, struct cgraph *cg, struct worklist *wl)
 {
-    push_list(s, cg->parents[node]);
-    push_list(s, cg->spouses[node]);
-    push_list(s, cg->children[node]);
+    enqueue_list(wl, cg->parents[node]);
+    enqueue_list(wl, cg->spouses[node]);
+    enqueue_list(wl, cg->children[node]);
 }
 
-
 /*
- * undirect_reversible_parents will undirected any parents of node that are not
- * compelled. It does two other things. It records unshielded colliders by
- * storing the pointer to the edge in compelled, and also makes the the edge
- * value negative if compelled
+ * undirect_reversible_parents will undirect any parents of node that are not
+ * compelled. Parents that form an unshielded collider on y are tagged
+ * compelled first. The reversible parents are collected in mem->buf before
+ * being undirected, since unorienting an edge modifies the parent list of y.
  */
-static void undirect_reversible_parents(int y, struct cgraph *cg, struct stack
-                                            **s, struct cel **compelled,
-                                            int *visited)
+static void undirect_reversible_parents(int y, struct cgraph *cg,
+                                            struct reorient_mem *mem)
 {
     struct edge_list *p1 = cg->parents[y];
     /* find all unshielded colliders on y */
@@ -123,9 +150,9 @@ static void undirect_reversible_parents(int y, struct cgraph *cg, struct stack
         while (p2) {
             /* If there is an unshielded collider make the edge compelled. */
             if (x != p2->node && !adjacent_in_cgraph(cg, x, p2->node)) {
-                make_compelled(compelled, p1);
+                make_compelled(mem, y, p1);
                 if (p2->tag == UNTAGGED)
-                    make_compelled(compelled, p2);
+                    make_compelled(mem, y, p2);
                 break;
             }
             p2 = p2->next;
@@ -133,41 +160,38 @@ static void undirect_reversible_parents(int y, struct cgraph *cg, struct stack
         NEXT_PARENT:
         p1 = p1->next;
     }
-    struct edge_list *cpy = copy_edge_list(cg->parents[y]);
-    struct edge_list *p   = cpy;
-    int node_modified = 0;
+    int *reversible = mem->buf;
+    int  n          = 0;
+    struct edge_list *p = cg->parents[y];
     while (p) {
-        int x = p->node;
-        if (p->tag == TAG_REVERSABLE) {
-            node_modified = 1;
-            unorient_directed_edge(cg, x, y);
-            visited[x] = 1;
-            visited[y] = 1;
-        }
+        if (p->tag == TAG_REVERSABLE)
+            reversible[n++] = p->node;
         p = p->next;
     }
-    free_edge_list(cpy);
-    if (node_modified) {
-        push_adjacents(y, cg, s);
-        push(s, y);
+    for (int i = 0; i < n; ++i)
+        unorient_directed_edge(cg, reversible[i], y);
+    if (n) {
+        enqueue_adjacents(y, cg, &mem->wl);
+        enqueue_node(&mem->wl, y);
     }
 }
 
-void reorient(struct cgraph *cg, int *nodes, int n, int *visited)
+/*
+ * reorient locally turns cg back into a pattern after an operator involving
+ * nodes has been applied.
+ */
+void reorient(struct cgraph *cg, int *nodes, int n, struct reorient_mem *mem)
 {
-    memset(visited, 0, cg->n_nodes * sizeof(int));
-    struct cel *compelled = NULL;
-    struct stack *s       = NULL;
     for (int i = 0; i < n; ++i) {
-        undirect_reversible_parents(nodes[i], cg, &s, &compelled, visited);
-        push_adjacents(nodes[i], cg, &s);
+        undirect_reversible_parents(nodes[i], cg, mem);
+        enqueue_adjacents(nodes[i], cg, &mem->wl);
     }
     for (int i = 0; i < n; ++i)
-        meek_rules(cg, nodes[i], &s, &compelled, visited);
+        meek_rules(cg, nodes[i], mem);
     int node;
-    while ((node = pop(&s)) >= 0) {
-        undirect_reversible_parents(node, cg, &s, &compelled, visited);
-        meek_rules(cg, node, &s, &compelled, visited);
+    while ((node = dequeue_node(&mem->wl)) >= 0) {
+        undirect_reversible_parents(node, cg, mem);
+        meek_rules(cg, node, mem);
     }
-    free_compelled(compelled);
+    free_compelled(cg, mem);
 }
@@ -0,0 +1,193 @@
+/*
+ * ges_screen.c implements candidate parent screening for GES. Before the
+ * search, each node y is given a short list of candidate parents: the K nodes
+ * that are most strongly associated with y according to a cheap pairwise
+ * statistic. The forward equivalence search then only scores the insertion
+ * operators x --> y where x is a candidate of y, so each rescoring costs O(K)
+ * score calls instead of O(nvar).
+ *
+ * The candidate sets are symmetric: x is a candidate of y if x is in the top K
+ * of y, or y is in the top K of x. Otherwise, an edge could only be added in
+ * one direction, and GES would no longer be able to reverse its mistakes.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <causality.h>
+#include <dataframe.h>
+
+#include <scores/linearalgebra.h>
+#include <ges/ges.h>
+#include <ges/ges_internal.h>
+
+struct screened_node {
+    double stat;
+    int    x;
+};
+
+/* sort nodes by decreasing statistic, breaking ties by the lowest node */
+static int compare_screened_nodes(const void *a, const void *b)
+{
+    const struct screened_node *u = a;
+    const struct screened_node *v = b;
+    if (u->stat > v->stat)
+        return -1;
+    if (u->stat < v->stat)
+        return 1;
+    return u->x - v->x;
+}
+
+/*
+ * mutual_information calculates the mutual information between the discrete
+ * variables x and y from their contingency table. counts must hold space for
+ * (states[x] + 1) * (states[y] + 1) integers.
+ */
+static double mutual_information(struct dataframe *df, int x, int y,
+                                     int *counts)
+{
+    int  nx  = df->states[x];
+    int  ny  = df->states[y];
+    int *n_x = counts + nx * ny;
+    int *n_y = n_x + nx;
+    int *dx  = df->df[x];
+    int *dy  = df->df[y];
+    for (int i = 0; i < (nx + 1) * (ny + 1) - 1; ++i)
+        counts[i] = 0;
+    double n  = 0.0f;
+    for (int i = 0; i < df->nobs; ++i) {
+        int w = df->weights ? df->weights[i] : 1;
+        counts[dx[i] * ny + dy[i]] += w;
+        n_x[dx[i]] += w;
+        n_y[dy[i]] += w;
+        n          += w;
+    }
+    double mi = 0.0f;
+    for (int i = 0; i < nx; ++i) {
+        for (int j = 0; j < ny; ++j) {
+            int n_ij = counts[i * ny + j];
+            if (n_ij)
+                mi += n_ij * log(n * n_ij / ((double) n_x[i] * n_y[j]));
+        }
+    }
+    return mi / n;
+}
+
+/*
+ * screen_row calculates the screening statistic between y and every node,
+ * and stores the nodes in top[0] ... top[k - 1] in order of decreasing
+ * association with y. Higher statistics mean stronger association.
+ */
+static void screen_row(struct cgraph *cg, struct ges_score gs, int y, int k,
+                           int statistic, int *top)
+{
+    struct dataframe *df = gs.df;
+    int nvar = df->nvar;
+    struct screened_node *nodes = malloc(nvar * sizeof(struct screened_node));
+    double *stat = malloc(nvar * sizeof(double));
+    if (statistic == SCREEN_CORRELATION) {
+        /* the data is normalized, so the covariance is the correlation */
+        if (df->cov) {
+            for (int x = 0; x < nvar; ++x)
+                stat[x] = df->cov[(size_t) y * nvar + x];
+        }
+        else {
+            calc_covariance_xy(stat, (double **) df->df, df->df[y], df->nobs,
+                                   nvar);
+        }
+        for (int x = 0; x < nvar; ++x)
+            stat[x] = fabs(stat[x]);
+    }
+    else if (statistic == SCREEN_MI) {
+        int max_states = 0;
+        for (int x = 0; x < nvar; ++x) {
+            if (df->states[x] > max_states)
+                max_states = df->states[x];
+        }
+        int *counts = malloc((max_states + 1) * (df->states[y] + 1) *
+                                 sizeof(int));
+        for (int x = 0; x < nvar; ++x)
+            stat[x] = x == y ? 0.0f : mutual_information(df, x, y, counts);
+        free(counts);
+    }
+    else {
+        if (gs.gsf == ges_bic_score)
+            ges_bic_optimization1(cg, y, nvar, &gs);
+        for (int x = 0; x < nvar; ++x) {
+            if (x != y)
+                stat[x] = -gs.gsf(df, x, y, NULL, 0, gs.args, gs.gsm);
+        }
+        if (gs.gsf == ges_bic_score)
+            free_ges_score_mem(gs.gsm);
+    }
+    int n = 0;
+    for (int x = 0; x < nvar; ++x) {
+        if (x == y)
+            continue;
+        nodes[n].stat = stat[x];
+        nodes[n].x    = x;
+        n++;
+    }
+    qsort(nodes, n, sizeof(struct screened_node), compare_screened_nodes);
+    for (int i = 0; i < k; ++i)
+        top[i] = nodes[i].x;
+    free(nodes);
+    free(stat);
+}
+
+/*
+ * screen_candidates builds the candidate parents of every node in cg, keeping
+ * the k nodes with the highest screening statistic. Rows are screened in
+ * parallel using nthreads threads. Returns NULL on failure.
+ */
+struct ges_candidates * screen_candidates(struct cgraph *cg,
+                                              struct ges_score gs, int k,
+                                              int statistic, int nthreads)
+{
+    int nvar = cg->n_nodes;
+    if (k > nvar - 1)
+        k = nvar - 1;
+    struct ges_candidates *cand = calloc(1, sizeof(struct ges_candidates));
+    int *top = malloc((nvar * k + 1) * sizeof(int));
+    if (!cand || !top)
+        goto ERR;
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+    for (int y = 0; y < nvar; ++y)
+        screen_row(cg, gs, y, k, statistic, top + y * k);
+    /* make the candidate sets symmetric */
+    cand->n_nodes = nvar;
+    cand->offsets = calloc(nvar + 1, sizeof(int));
+    cand->nodes   = malloc((2 * nvar * k + 1) * sizeof(int));
+    int *fill     = malloc(nvar * sizeof(int));
+    if (!cand->offsets || !cand->nodes || !fill) {
+        free(fill);
+        goto ERR;
+    }
+    for (int y = 0; y < nvar; ++y) {
+        for (int i = 0; i < k; ++i) {
+            cand->offsets[y + 1]++;
+            cand->offsets[top[y * k + i] + 1]++;
+        }
+    }
+    for (int y = 0; y < nvar; ++y)
+        cand->offsets[y + 1] += cand->offsets[y];
+    for (int y = 0; y < nvar; ++y)
+        fill[y] = cand->offsets[y];
+    for (int y = 0; y < nvar; ++y) {
+        for (int i = 0; i < k; ++i) {
+            int x = top[y * k + i];
+            cand->nodes[fill[y]++] = x;
+            cand->nodes[fill[x]++] = y;
+        }
+    }
+    sort_ges_candidates(cand);
+    free(fill);
+    free(top);
+    return cand;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for GES candidate screening.\n");
+    free(top);
+    if (cand)
+        free_ges_candidates(cand);
+    return NULL;
+}
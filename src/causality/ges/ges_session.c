@@ -0,0 +1,229 @@
+/*
+ * ges_session.c implements GES sessions, which learn a pattern from data that
+ * arrives in batches. Instead of searching from the empty graph for every
+ * batch, a session keeps the state of its search (the pattern, the operators
+ * and their heap, and the table of scored insertion operators), and for every
+ * batch only rescores the nodes whose scores moved, and then runs FES and BES
+ * from the current pattern to repair it.
+ *
+ * Whether the scores of the operators into y moved is decided with probes:
+ * the score differences of adding each x --> y to the current parents of y,
+ * which are cheap to compute. The probes are kept from the last time the
+ * operators into y were rescored, and if none of them has moved more than
+ * the tolerance on the new data, the stored operators are kept as they are.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <causality.h>
+#include <dataframe.h>
+
+#include <cgraph/cgraph.h>
+#include <ges/ges.h>
+#include <ges/ges_internal.h>
+
+struct ges_session {
+    struct ges_search   search;
+    struct ges_settings settings;
+    double             *probes;    /* n_nodes x n_nodes, row y for node y */
+    double              tolerance;
+};
+
+/*
+ * probe_row stores in probes[x] the score difference of adding x --> y to the
+ * parents of y, for every (candidate) x that is not adjacent to y, and zero
+ * for the other nodes.
+ */
+static void probe_row(struct ges_search *s, int y, double *probes)
+{
+    struct cgraph         *cg   = s->cg;
+    struct ges_candidates *cand = s->cand;
+    struct ges_score       gs   = s->score;
+    struct ges_operator    py   = {0};
+    py.y = y;
+    calculate_parents(cg, &py);
+    memset(probes, 0, cg->n_nodes * sizeof(double));
+    int *xs  = NULL;
+    int  n_x = cg->n_nodes;
+    if (cand) {
+        xs  = cand->nodes + cand->offsets[y];
+        n_x = cand->offsets[y + 1] - cand->offsets[y];
+    }
+    if (!cand)
+        apply_optimization1(cg, y, cg->n_nodes, &gs);
+    else if (gs.gsf == ges_bic_score)
+        ges_bic_optimization_subset(cg, y, xs, n_x, &gs);
+    for (int i = 0; i < n_x; ++i) {
+        int x = xs ? xs[i] : i;
+        if (x == y || adjacent_in_cgraph(cg, x, y))
+            continue;
+        apply_optimization2(cg, x, &gs);
+        probes[x] = gs.gsf(gs.df, x, y, py.parents, py.n_parents, gs.args,
+                               gs.gsm);
+    }
+    free(py.parents);
+    if (gs.gsf == ges_bic_score)
+        free_ges_score_mem(gs.gsm);
+}
+
+/*
+ * refresh_rows brings the operator table up to date. The operators into a
+ * node are rescored if BES changed the graph around it, or if settle is zero
+ * (new data arrived) and one of its probes moved more than the tolerance.
+ * Rescored nodes get new probes, and if settle is nonzero, so do the nodes FES
+ * rescored. Returns the number of nodes that were rescored.
+ */
+static int refresh_rows(struct ges_session *session, int settle)
+{
+    struct ges_search *s = &session->search;
+    int nvar       = s->cg->n_nodes;
+    int nprocs     = s->settings->nthreads > 0 ? s->settings->nthreads : 1;
+    int n_rescored = 0;
+    #pragma omp parallel for num_threads(nprocs) schedule(dynamic) \
+        reduction(+:n_rescored)
+    for (int y = 0; y < nvar; ++y) {
+        int mark = s->marks[y];
+        if (settle && !mark)
+            continue;
+        double *ref   = session->probes + (size_t) y * nvar;
+        double *probe = malloc(nvar * sizeof(double));
+        int    *mem   = malloc(2 * nvar * sizeof(int));
+        probe_row(s, y, probe);
+        int rescore = mark & GES_STALE_TABLE;
+        if (!settle) {
+            rescore |= mark & GES_STALE_PROBE;
+            for (int x = 0; x < nvar && !rescore; ++x)
+                rescore = fabs(probe[x] - ref[x]) > session->tolerance;
+        }
+        if (rescore) {
+            update_insertion_row(s->cg, s->tbl, y, s->cand, s->settings,
+                                     s->score, mem);
+            n_rescored++;
+        }
+        if (rescore || settle)
+            memcpy(ref, probe, nvar * sizeof(double));
+        s->marks[y] = 0;
+        free(probe);
+        free(mem);
+    }
+    return n_rescored;
+}
+
+/*
+ * create_ges_session runs GES on the data in score, starting from cg (which is
+ * left unchanged), and keeps the state of the search so it can be updated
+ * with update_ges_session. The score of the pattern relative to cg is stored
+ * in graph_score. tolerance is how far a probe can move before the operators
+ * into its node are rescored; zero rescores every node whose scores changed
+ * at all. score.args and settings->knowledge must outlive the session, and
+ * the candidates and effect edges found by settings are kept for all the
+ * batches. The session keeps n_nodes^2 probes. Returns NULL on failure.
+ */
+struct ges_session * create_ges_session(struct ges_score score,
+                                            struct cgraph *cg,
+                                            struct ges_settings *settings,
+                                            double tolerance,
+                                            double *graph_score,
+                                            struct ges_stats *stats)
+{
+    struct ges_settings defaults = {.nthreads = 1,
+                                    .screening = SCREEN_CORRELATION};
+    if (stats)
+        memset(stats, 0, sizeof(struct ges_stats));
+    int nvar = cg->n_nodes;
+    struct ges_session *session = calloc(1, sizeof(struct ges_session));
+    struct cgraph      *copy    = copy_cgraph(cg);
+    if (!session || !copy)
+        goto ERR;
+    session->settings  = settings ? *settings : defaults;
+    session->tolerance = tolerance;
+    int nthreads = session->settings.nthreads;
+    if (score.gsf == ges_bic_score &&
+            ges_bic_covariance_matrix(score.df, nthreads > 0 ? nthreads : 1))
+        goto ERR;
+    if (init_ges_search(&session->search, score, copy, &session->settings))
+        goto ERR;
+    session->search.marks = calloc(nvar, sizeof(unsigned char));
+    session->probes       = malloc((size_t) nvar * nvar * sizeof(double));
+    if (!session->search.marks || !session->probes)
+        goto ERR;
+    struct ges_search *s = &session->search;
+    ges_step0(s, stats);
+    *graph_score  = ges_forward_search(s);
+    *graph_score += ges_backward_search(s);
+    if (stats)
+        stats->subset_pruning = ges_subset_pruning(s);
+    memset(s->marks, GES_STALE_PROBE, nvar);
+    refresh_rows(session, 1);
+    return session;
+    ERR:
+    CAUSALITY_ERROR("Failed to create GES session.\n");
+    if (session && session->search.cg)
+        free_ges_session(session);
+    else {
+        free(session);
+        if (copy)
+            free_cgraph(copy);
+    }
+    return NULL;
+}
+
+/*
+ * update_ges_session updates the session with df, which holds all of the data
+ * seen so far (e.g. sufficient statistics that a new batch was added to), and
+ * must have the same variables as the data the session was created with. The
+ * nodes whose probes moved are rescored, and the pattern is repaired by FES
+ * and BES. For the BIC score, the covariance matrix of df is calculated if it
+ * is not already present. The dataframe must outlive the session, or the
+ * next update. The change in score made by the repair is stored in
+ * score_diff. Returns nonzero on failure, in which case the session is left
+ * unchanged and still scores the previous data.
+ */
+int update_ges_session(struct ges_session *session, struct dataframe *df,
+                           double *score_diff, struct ges_stats *stats)
+{
+    struct ges_search *s = &session->search;
+    int nthreads = s->settings->nthreads > 0 ? s->settings->nthreads : 1;
+    if (stats)
+        memset(stats, 0, sizeof(struct ges_stats));
+    if (df->nvar != s->cg->n_nodes) {
+        CAUSALITY_ERROR("Data does not match the GES session.\n");
+        return 1;
+    }
+    if (s->score.gsf == ges_bic_score &&
+            ges_bic_covariance_matrix(df, nthreads))
+        return 1;
+    s->score.df = df;
+    int n_rescored = refresh_rows(session, 0);
+    if (stats)
+        stats->n_rescored = n_rescored;
+    select_insertion_operators(s);
+    *score_diff  = ges_forward_search(s);
+    *score_diff += ges_backward_search(s);
+    refresh_rows(session, 1);
+    return 0;
+}
+
+/*
+ * ges_session_graph returns a copy of the pattern learned by the session, with
+ * the edges oriented by background knowledge.
+ */
+struct cgraph * ges_session_graph(struct ges_session *session)
+{
+    struct cgraph *cg = copy_cgraph(session->search.cg);
+    if (cg && session->settings.knowledge)
+        orient_with_knowledge(cg, session->settings.knowledge);
+    return cg;
+}
+
+void free_ges_session(struct ges_session *session)
+{
+    struct cgraph *cg = session->search.cg;
+    free_ges_search(&session->search);
+    if (cg)
+        free_cgraph(cg);
+    free(session->probes);
+    free(session);
+}
@@ -0,0 +1,207 @@
+/*
+ * ges_table.c implements the operator table used by the forward equivalence
+ * search of GES. Instead of only keeping the best insertion operator into each
+ * node, the table keeps every scored insertion operator x --> y that improves
+ * the score, so when the graph changes only the operators that are affected
+ * by the change need to be rescored. Each row of the table is an unsorted
+ * array, because rows only hold the operators that improve the score and so
+ * are expected to be short.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <causality.h>
+#include <ges/ges_internal.h>
+
+struct ges_table * create_ges_table(int n_nodes)
+{
+    struct ges_table *tbl = malloc(sizeof(struct ges_table));
+    if (!tbl)
+        goto ERR;
+    tbl->n_nodes = n_nodes;
+    tbl->rows    = calloc(n_nodes, sizeof(struct ges_row));
+    if (!tbl->rows) {
+        free(tbl);
+        goto ERR;
+    }
+    return tbl;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for GES operator table.\n");
+    return NULL;
+}
+
+void free_ges_table(struct ges_table *tbl)
+{
+    for (int i = 0; i < tbl->n_nodes; ++i)
+        free(tbl->rows[i].entries);
+    free(tbl->rows);
+    free(tbl);
+}
+
+void clear_table_row(struct ges_table *tbl, int y)
+{
+    tbl->rows[y].size = 0;
+}
+
+static struct ges_entry * find_entry(struct ges_row *row, int x)
+{
+    for (int i = 0; i < row->size; ++i) {
+        if (row->entries[i].x == x)
+            return row->entries + i;
+    }
+    return NULL;
+}
+
+void remove_table_entry(struct ges_table *tbl, int x, int y)
+{
+    struct ges_row   *row = tbl->rows + y;
+    struct ges_entry *e   = find_entry(row, x);
+    if (e)
+        *e = row->entries[--row->size];
+}
+
+/*
+ * set_table_entry stores the operator x --> y with tail set t and the given
+ * score difference in the table. Operators that do not improve the score are
+ * not stored, and any previous entry for x --> y is removed.
+ */
+void set_table_entry(struct ges_table *tbl, int x, int y, uint64_t t,
+                         double score_diff)
+{
+    struct ges_row   *row = tbl->rows + y;
+    struct ges_entry *e   = find_entry(row, x);
+    if (score_diff > 0.0f) {
+        if (e)
+            *e = row->entries[--row->size];
+        return;
+    }
+    if (!e) {
+        if (row->size == row->capacity) {
+            int capacity = row->capacity ? 2 * row->capacity : 4;
+            void *p = realloc(row->entries, capacity * sizeof(struct ges_entry));
+            if (!p) {
+                CAUSALITY_ERROR("Failed to grow GES operator table.\n");
+                return;
+            }
+            row->entries  = p;
+            row->capacity = capacity;
+        }
+        e = row->entries + row->size++;
+    }
+    e->x          = x;
+    e->t          = t;
+    e->score_diff = score_diff;
+}
+
+/*
+ * best_table_entry returns the stored operator into y with the lowest score
+ * difference, breaking ties in favor of the lowest x, or NULL if there is none.
+ */
+struct ges_entry * best_table_entry(struct ges_table *tbl, int y)
+{
+    struct ges_row   *row  = tbl->rows + y;
+    struct ges_entry *best = NULL;
+    for (int i = 0; i < row->size; ++i) {
+        struct ges_entry *e = row->entries + i;
+        if (!best || e->score_diff < best->score_diff ||
+                (e->score_diff == best->score_diff && e->x < best->x))
+            best = e;
+    }
+    return best;
+}
+
+/*
+ * effect_edges_from_table returns the effect edges found in FES STEP 0, i.e.
+ * for each node y the nodes x such that x --> y (or equivalently y --> x)
+ * improves the score of the initial graph. Since FES STEP 0 usually only
+ * scores one direction of each pair, each stored operator x --> y makes both
+ * x a candidate of y and y a candidate of x.
+ */
+struct ges_candidates * effect_edges_from_table(struct ges_table *tbl)
+{
+    int n_nodes = tbl->n_nodes;
+    struct ges_candidates *cand = calloc(1, sizeof(struct ges_candidates));
+    if (!cand)
+        goto ERR;
+    cand->n_nodes = n_nodes;
+    cand->offsets = calloc(n_nodes + 1, sizeof(int));
+    if (!cand->offsets)
+        goto ERR;
+    for (int y = 0; y < n_nodes; ++y) {
+        struct ges_row *row = tbl->rows + y;
+        for (int i = 0; i < row->size; ++i) {
+            cand->offsets[y + 1]++;
+            cand->offsets[row->entries[i].x + 1]++;
+        }
+    }
+    for (int y = 0; y < n_nodes; ++y)
+        cand->offsets[y + 1] += cand->offsets[y];
+    int *fill = malloc(n_nodes * sizeof(int));
+    cand->nodes = malloc((cand->offsets[n_nodes] + 1) * sizeof(int));
+    if (!fill || !cand->nodes) {
+        free(fill);
+        goto ERR;
+    }
+    memcpy(fill, cand->offsets, n_nodes * sizeof(int));
+    for (int y = 0; y < n_nodes; ++y) {
+        struct ges_row *row = tbl->rows + y;
+        for (int i = 0; i < row->size; ++i) {
+            int x = row->entries[i].x;
+            cand->nodes[fill[y]++] = x;
+            cand->nodes[fill[x]++] = y;
+        }
+    }
+    free(fill);
+    sort_ges_candidates(cand);
+    return cand;
+    ERR:
+    CAUSALITY_ERROR("Failed to allocate memory for GES effect edges.\n");
+    if (cand)
+        free_ges_candidates(cand);
+    return NULL;
+}
+
+/*
+ * sort_ges_candidates sorts the candidates of each node and removes any
+ * duplicates in place.
+ */
+void sort_ges_candidates(struct ges_candidates *cand)
+{
+    int size = 0;
+    for (int y = 0; y < cand->n_nodes; ++y) {
+        int *nodes = cand->nodes + cand->offsets[y];
+        int  n     = cand->offsets[y + 1] - cand->offsets[y];
+        sort_nodes(nodes, n);
+        cand->offsets[y] = size;
+        for (int i = 0; i < n; ++i) {
+            if (i == 0 || nodes[i] != nodes[i - 1])
+                cand->nodes[size++] = nodes[i];
+        }
+    }
+    cand->offsets[cand->n_nodes] = size;
+}
+
+void free_ges_candidates(struct ges_candidates *cand)
+{
+    free(cand->offsets);
+    free(cand->nodes);
+    free(cand);
+}
+
+/* is_candidate returns whether or not x is a candidate parent of y */
+int is_candidate(struct ges_candidates *cand, int x, int y)
+{
+    int lo = cand->offsets[y];
+    int hi = cand->offsets[y + 1] - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (cand->nodes[mid] == x)
+            return 1;
+        if (cand->nodes[mid] < x)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return 0;
+}
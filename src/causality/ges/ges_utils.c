@@ -6,6 +6,7 @@
  * small compared to scoring.
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -57,6 +58,40 @@ int valid_fes_clique(struct cgraph *cg, struct ges_operator *op)
     }
     return 1;
 }
+/*
+ * adjacency_masks sets bit j of adj[i] if nodes[i] and nodes[j] are adjacent
+ * in cg, for the n <= 64 nodes in nodes. The clique checks of an operator's
+ * subsets then take a few bit operations each, instead of walking adjacency
+ * lists for every pair of nodes in the subset.
+ */
+void adjacency_masks(struct cgraph *cg, int *nodes, int n, uint64_t *adj)
+{
+    for (int i = 0; i < n; ++i)
+        adj[i] = 0;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < i; ++j) {
+            if (adjacent_in_cgraph(cg, nodes[i], nodes[j])) {
+                adj[i] |= (uint64_t) 1 << j;
+                adj[j] |= (uint64_t) 1 << i;
+            }
+        }
+    }
+}
+
+/*
+ * is_clique_mask returns whether the nodes in the bitmask set are pairwise
+ * adjacent, given the adjacency masks adj of the n nodes.
+ */
+int is_clique_mask(uint64_t set, uint64_t *adj, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        uint64_t bit = (uint64_t) 1 << i;
+        if ((set & bit) && (set & ~bit & ~adj[i]))
+            return 0;
+    }
+    return 1;
+}
+
 /*
  * valid_fes_clique checks to see if the set nayx/H
  * forms a clique.
@@ -153,9 +188,120 @@ int cycle_created(struct cgraph *cg, struct ges_operator *op, int *mem)
     return 0;
 }
 
+/*
+ * first_stops searches the semi-directed paths that leave from, avoid nayx,
+ * and do not pass the stops of the operator op. Returns the bitmask of the
+ * stops the paths end at, and sets reaches_x if one of them reaches x.
+ */
+static uint64_t first_stops(struct cgraph *cg, struct ges_operator *op,
+                                uint64_t stops, int from, int *mem,
+                                int *reaches_x)
+{
+    unsigned char *marked = (unsigned char *) mem;
+    memset(marked, 0, cg->n_nodes / 8 + 1);
+    for (int i = 0; i < op->nayx_size; ++i)
+        mark(op->nayx[i], marked);
+    for (int i = 0; i < op->set_size; ++i) {
+        if (IS_TAIL_NODE(stops, i))
+            mark(op->set[i], marked);
+    }
+    uint64_t reached = 0;
+    int     *queue   = mem + cg->n_nodes;
+    int      size    = 1;
+    queue[0]   = from;
+    *reaches_x = 0;
+    for (int i = 0; i < size; ++i) {
+        for (int e = 0; e < 2; ++e) {
+            struct edge_list *p = e ? cg->spouses[queue[i]] :
+                                      cg->children[queue[i]];
+            for (; p; p = p->next) {
+                if (p->node == op->xp) {
+                    *reaches_x = 1;
+                    return reached;
+                }
+                if (!is_marked(p->node, marked)) {
+                    mark(p->node, marked);
+                    queue[size++] = p->node;
+                    continue;
+                }
+                for (int j = 0; j < op->set_size; ++j) {
+                    if (IS_TAIL_NODE(stops, j) && op->set[j] == p->node)
+                        reached |= (uint64_t) 1 << j;
+                }
+            }
+        }
+    }
+    return reached;
+}
+
+/*
+ * find_tail_paths computes the paths of the insertion operator op once (see
+ * tail_paths), so that the cycle test of each set T of op, which may only
+ * contain nodes in stops, is a few bit operations instead of a search of cg.
+ * Stops that are never in T need not be cut at, so stops should be as small
+ * as possible. mem is the memory of cycle_created.
+ */
+void find_tail_paths(struct cgraph *cg, struct ges_operator *op, uint64_t stops,
+                         int *mem, struct tail_paths *paths)
+{
+    paths->stops  = stops;
+    paths->to_x   = 0;
+    paths->from_y = first_stops(cg, op, stops, op->y, mem, &paths->y_to_x);
+    /* if y reaches x without passing a stop, every T creates a cycle */
+    if (paths->y_to_x)
+        return;
+    for (int i = 0; i < op->set_size; ++i) {
+        int reaches_x = 0;
+        paths->from_stop[i] = 0;
+        if (!IS_TAIL_NODE(stops, i))
+            continue;
+        paths->from_stop[i] = first_stops(cg, op, stops, op->set[i], mem,
+                                              &reaches_x);
+        if (reaches_x)
+            paths->to_x |= (uint64_t) 1 << i;
+    }
+}
+
+/*
+ * tail_creates_cycle returns whether adding x --> y with the set T = t, whose
+ * nodes are all stops, creates a cycle, i.e. whether cycle_created would.
+ */
+int tail_creates_cycle(struct tail_paths *paths, uint64_t t)
+{
+    if (paths->y_to_x)
+        return 1;
+    uint64_t reached  = paths->from_y & ~t;
+    uint64_t frontier = reached;
+    while (frontier) {
+        if (frontier & paths->to_x)
+            return 1;
+        uint64_t next = 0;
+        for (int i = 0; i < 64 && frontier >> i; ++i) {
+            if ((frontier >> i) & 1)
+                next |= paths->from_stop[i];
+        }
+        frontier = next & ~t & ~reached;
+        reached |= frontier;
+    }
+    return 0;
+}
+
+/* compare_nodes is used to sort nodes in ascending order */
+static int compare_nodes(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+void sort_nodes(int *nodes, int n)
+{
+    qsort(nodes, n, sizeof(int), compare_nodes);
+}
+
 /*
  * partition_neighbors partitions the neighbors of op.y into those adjacent
- * to opx (nayx) in cg and those nonadjacent to op.x (set). Used in FES.
+ * to opx (nayx) in cg and those nonadjacent to op.x (set). Used in FES. Both
+ * are sorted so that a tail set stored as a bitmask over set does not depend
+ * on the order of the spouses of y.
  */
 void partition_neighbors(struct cgraph *cg, struct ges_operator *op)
 {
@@ -173,6 +319,8 @@ void partition_neighbors(struct cgraph *cg, struct ges_operator *op)
             o.set[o.set_size++] = s->node;
         s = s->next;
     }
+    sort_nodes(o.nayx, o.nayx_size);
+    sort_nodes(o.set, o.set_size);
     *op = o;
 }
 
@@ -209,67 +357,14 @@ void calculate_parents(struct cgraph *cg, struct ges_operator *op)
 }
 
 /*
-* reorient_and_determine_operators_to_update reorients the cgraph after
-* applying a ges operator (insertion or deletion). It also passes along the
-* information from the reorient functions in ges_reorient.c to
-* deterimine_nodes_to_recalc to get the nodes and the number of nodes
-* we need to recalculate.
-*/
-int get_insertion_operators_to_update(int *nodes, struct cgraph *cpy,
-                                          struct cgraph *cg, struct ges_operator
-                                          *op, int *visited)
-{
-    int n_nodes = cg->n_nodes;
-    int n = 0;
-    visited[op->y]  = 1;
-    visited[op->xp] = 1;
-    for (int i = 0; i < op->set_size; ++i) {
-        if (IS_TAIL_NODE(op->t, i))
-                visited[op->set[i]] = 1;
-    }
-    for (int i = 0; i < n_nodes; ++i) {
-        if (visited[i] && !identical_in_cgraphs(cg, cpy, i)) {
-            free_edge_list(cpy->parents[i]);
-            cpy->parents[i] = copy_edge_list(cg->parents[i]);
-            free_edge_list(cpy->spouses[i]);
-            cpy->spouses[i] = copy_edge_list(cg->spouses[i]);
-            free_edge_list(cpy->children[i]);
-            cpy->children[i] = copy_edge_list(cg->children[i]);
-            nodes[n++] = i;
-        }
-    }
-    return n;
-}
-
-int get_deletion_operators_to_update(int *nodes, struct cgraph *cpy,
-                                         struct cgraph *cg, struct ges_operator
-                                         *op, int *visited)
+ * get_operators_to_update stores the nodes whose operators need to be
+ * recalculated after an operator has been applied and cg has been reoriented
+ * in nodes, in ascending order. These are the nodes whose adjacencies changed
+ * during the current epoch of cg.
+ */
+int get_operators_to_update(int *nodes, struct cgraph *cg)
 {
-    int  n_nodes = cg->n_nodes;
-    int  n       = 0;
-    visited[op->y]  = 1;
-    visited[op->xp] = 1;
-    for (int i = 0; i < op->nayx_size; ++i) {
-        if (IS_HEAD_NODE(op->h, i))
-            visited[op->nayx[i]] = 1;
-    }
-    for (int i = 0; i < n_nodes; ++i) {
-        if (visited[i] && !identical_in_cgraphs(cg, cpy, i)) {
-            free_edge_list(cpy->parents[i]);
-            cpy->parents[i] = copy_edge_list(cg->parents[i]);
-            free_edge_list(cpy->spouses[i]);
-            cpy->spouses[i] = copy_edge_list(cg->spouses[i]);
-            free_edge_list(cpy->children[i]);
-            cpy->children[i] = copy_edge_list(cg->children[i]);
-            n++;
-        }
-        else
-            visited[i] = 0;
-    }
-    int j = 0;
-    for (int i = 0; i < n_nodes; ++i) {
-        if (visited[i])
-            nodes[j++] = i;
-    }
+    int n = get_changed_nodes(cg, nodes);
+    sort_nodes(nodes, n);
     return n;
 }
@@ -4,13 +4,74 @@
 #include <dataframe.h>
 #include <causality.h>
 #include <scores/scores.h>
+#include <scores/contingency.h>
+#include <scores/score_cache.h>
+#include <data/adtree.h>
 
-double bdeu_score(struct dataframe *df, int *xy, int npar,
-                      struct score_args *args)
+/*
+ * bdeu_table_score scores the counts n_jk of the n_y_states states of y for
+ * each of the n_x_states states of its npar parents, where n_j are the row
+ * sums of n_jk.
+ */
+static double bdeu_table_score(int *n_jk, int *n_j, int n_x_states,
+                                   int n_y_states, int npar, int nvar,
+                                   struct score_args *args)
 {
     double sample_prior    = args->fargs[0];
     double structure_prior = args->fargs[1];
+    double score = npar * log(structure_prior/(nvar - 1))
+                    + (nvar - npar) * log(1.0f - structure_prior / (nvar - 1));
+    double cell_prior = sample_prior / (n_x_states * n_y_states);
+    double row_prior  = sample_prior / n_x_states;
+    score += n_x_states * lgamma(row_prior);
+    score -= n_y_states * n_x_states * lgamma(cell_prior);
+    if (args->cache) {
+        score -= sum_lgammas(args->cache, row_prior, n_j, n_x_states);
+        score += sum_lgammas(args->cache, cell_prior, n_jk,
+                                 n_x_states * n_y_states);
+        return score;
+    }
+    for(int i = 0; i < n_x_states; ++i) {
+        score -= lgamma(row_prior + n_j[i]);
+        for(int j = 0; j < n_y_states; ++j)
+            score += lgamma(cell_prior + n_jk[j + i * n_y_states]);
+    }
+    return score;
+}
+
+/*
+ * bdeu_sparse_table_score is bdeu_table_score for a sparse table, whose empty
+ * cells and rows are skipped, as they add lgamma(prior) - lgamma(prior) to
+ * the score.
+ */
+static double bdeu_sparse_table_score(struct contingency_table *ct,
+                                          double n_x_states, int n_y_states,
+                                          int npar, int nvar,
+                                          struct score_args *args)
+{
+    double sample_prior    = args->fargs[0];
+    double structure_prior = args->fargs[1];
+    double score = npar * log(structure_prior/(nvar - 1))
+                    + (nvar - npar) * log(1.0f - structure_prior / (nvar - 1));
+    double cell_prior = sample_prior / (n_x_states * n_y_states);
+    double row_prior  = sample_prior / n_x_states;
+    score += ct->n_rows * lgamma(row_prior);
+    score -= ct->n_cells * lgamma(cell_prior);
+    if (args->cache) {
+        score -= sum_lgammas(args->cache, row_prior, ct->n_j, ct->n_rows);
+        score += sum_lgammas(args->cache, cell_prior, ct->n_jk, ct->n_cells);
+        return score;
+    }
+    for (int i = 0; i < ct->n_rows; ++i)
+        score -= lgamma(row_prior + ct->n_j[i]);
+    for (int i = 0; i < ct->n_cells; ++i)
+        score += lgamma(cell_prior + ct->n_jk[i]);
+    return score;
+}
 
+double bdeu_score(struct dataframe *df, int *xy, int npar,
+                      struct score_args *args)
+{
     int *data[npar + 1];
     for(int i = 0; i < npar + 1; ++i)
         data[i] = df->df[xy[i]];
@@ -18,6 +79,18 @@ double bdeu_score(struct dataframe *df, int *xy, int npar,
     int *y          = data[npar];
     int  n_y_states = df->states[xy[npar]];
 
+    if (use_sparse_table(df, xy, npar)) {
+        struct contingency_table ct;
+        if (sparse_contingency_table(df, xy, npar, &ct))
+            return 0.0;
+        double score = bdeu_sparse_table_score(&ct,
+                                                   parent_states(df, xy, npar),
+                                                   n_y_states, npar, df->nvar,
+                                                   args);
+        free_contingency_table(&ct);
+        return score;
+    }
+
     /* get the number of states for each x */
     int x_states[npar];
     for(int i = 0; i < npar; ++i)
@@ -41,8 +114,12 @@ double bdeu_score(struct dataframe *df, int *xy, int npar,
      * the stack is a good idea.
      */
     int x_state [npar];
-    for (int i = 0; i < df->nobs; ++i) {
+    /* count from the adtree if there is one, otherwise from the rows */
+    int counted = df->adtree && !adtree_counts(df->adtree, xy, npar + 1, n_jk,
+                                                   n_j);
+    for (int i = 0; i < df->nobs && !counted; ++i) {
         int y_state = y[i];
+        int w       = df->weights ? df->weights[i] : 1;
         for (int j = 0; j < npar; ++j)
             x_state[j] = data[j][i];
         /* convert the macro state of x into an index (i.e. k) for n_jk */
@@ -51,23 +128,67 @@ double bdeu_score(struct dataframe *df, int *xy, int npar,
             k *= x_states[j];
             k += x_state[j];
         }
-        /* increment the observed microstate (x,y) by 1 in n_jk */
-        n_jk[k * n_y_states + y_state]++;
-        /* increment observed microstate (y) by 1 in n_j */
-        n_j[k]++;
-    }
-    int nvar     = df->nvar;
-    double score = npar * log(structure_prior/(nvar - 1))
-                    + (nvar - npar) * log(1.0f - structure_prior / (nvar - 1));
-    double cell_prior = sample_prior / (n_x_states * n_y_states);
-    double row_prior  = sample_prior / n_x_states;
-    score += n_x_states * lgamma(row_prior);
-    score -= n_y_states * n_x_states * lgamma(cell_prior);
-    for(int i = 0; i < n_x_states; ++i) {
-        score -= lgamma(row_prior + n_j[i]);
-        for(int j = 0; j < n_y_states; ++j)
-            score += lgamma(cell_prior + n_jk[j + i * n_y_states]);
+        /* increment the observed microstate (x,y) by w in n_jk */
+        n_jk[k * n_y_states + y_state] += w;
+        /* increment observed microstate (y) by w in n_j */
+        n_j[k] += w;
     }
+    double score = bdeu_table_score(n_jk, n_j, n_x_states, n_y_states, npar,
+                                        df->nvar, args);
     free(alloced_mem);
     return score;
 }
+
+/*
+ * bdeu_tables_score_diff scores the tables of y with and without x, built by
+ * contingency_tables from xy, npar, and n_xy, and returns the difference.
+ */
+static double bdeu_tables_score_diff(struct dataframe *df, int *xy, int npar,
+                                         int *n_xy, struct score_args *args)
+{
+    struct contingency_tables ct;
+    if (contingency_tables(df, xy, npar, n_xy, &ct))
+        return 0.0;
+    int    n_y_states = df->states[xy[npar + 1]];
+    double score_plus, score_minus;
+    if (ct.sparse) {
+        score_plus  = bdeu_sparse_table_score(&ct.plus, ct.plus_states,
+                                                  n_y_states, npar + 1,
+                                                  df->nvar, args);
+        score_minus = bdeu_sparse_table_score(&ct.minus, ct.minus_states,
+                                                  n_y_states, npar, df->nvar,
+                                                  args);
+    }
+    else {
+        score_plus  = bdeu_table_score(ct.plus_jk, ct.plus_j, ct.plus_states,
+                                           n_y_states, npar + 1, df->nvar,
+                                           args);
+        score_minus = bdeu_table_score(ct.minus_jk, ct.minus_j,
+                                           ct.minus_states, n_y_states, npar,
+                                           df->nvar, args);
+    }
+    free_contingency_tables(&ct);
+    return score_plus - score_minus;
+}
+
+/*
+ * bdeu_score_diff returns the difference in the BDeu score of y made by adding
+ * x to its parents. xy holds x, the npar parents of y, and y.
+ */
+double bdeu_score_diff(struct dataframe *df, int *xy, int npar,
+                           struct score_args *args)
+{
+    return bdeu_tables_score_diff(df, xy, npar, NULL, args);
+}
+
+/*
+ * bdeu_pair_score_diff is bdeu_score_diff for adding x to the parents of y
+ * when y has no other parents, scored from the counts n_xy of the states of
+ * x and y that the caller already took, with x the most significant.
+ */
+double bdeu_pair_score_diff(struct dataframe *df, int x, int y, int *n_xy,
+                                struct score_args *args)
+{
+    int xy[2] = {x, y};
+    return bdeu_tables_score_diff(df, xy, 0, n_xy, args);
+}
@@ -27,20 +27,31 @@ double bic_score(struct dataframe *df, int *xy, int npar, struct score_args *arg
 {
     double penalty = args->fargs[0];
     int    nobs    = df->nobs;
-    double *y      = df->df[xy[npar]];
-    /* allocate memory for submatrix and fill in the columns */
-    double **x      = malloc(npar * sizeof(double *));
-    for (int i = 0; i < npar; ++i)
-        x[i] = df->df[xy[i]];
-
     /* Allocate memory for cov_xx and cov_xy in one block. */
     double *mem    = calloc((npar) * (npar + 2), sizeof(double));
     double *cov_xx = mem;
     double *cov_xy = mem + npar * npar;
     double *cov_xy_t = mem + npar * (npar + 1);
+    if (df->cov) {
+        /* look the covariances up in the precalculated covariance matrix */
+        for (int i = 0; i < npar; ++i) {
+            double *cov_i = df->cov + (size_t) xy[i] * df->nvar;
+            cov_xy[i] = cov_i[xy[npar]];
+            for (int j = 0; j < npar; ++j)
+                cov_xx[i * npar + j] = cov_i[xy[j]];
+        }
+    }
+    else {
+        double *y      = df->df[xy[npar]];
+        /* allocate memory for submatrix and fill in the columns */
+        double **x      = malloc(npar * sizeof(double *));
+        for (int i = 0; i < npar; ++i)
+            x[i] = df->df[xy[i]];
+        calc_covariance_matrix(cov_xx, x, nobs, npar);
+        calc_covariance_xy(cov_xy, x, y, nobs, npar);
+        free(x);
+    }
     memcpy(cov_xy_t, cov_xy, npar * sizeof(double));
-    calc_covariance_matrix(cov_xx, x, nobs, npar);
-    calc_covariance_xy(cov_xy, x, y, nobs, npar);
     double rss = calculate_rss(mem, npar);
     free(mem);
     return calcluate_bic(rss, penalty, nobs, npar);
@@ -79,10 +90,21 @@ double calculate_rss(double *cov, int m)
                    - 2 * cov_xx[1] * cov_xy[0] * cov_xy[1]) / det;
         return rss;
     }
+    else if (m <= SMALL_KERNEL_MAX) {
+        /* parent sets this small have kernels specialized for their size */
+        double form;
+        int err = calc_small_quadratic_form(cov_xx, cov_xy, m, &form);
+        if (err)
+            CAUSALITY_ERROR("Leading minor of order %i not positive!\n", err);
+        else
+            rss -= form;
+        return rss;
+    }
     else {
         /*
-         * for m >= 3, we use the cholesky decompoistion and forward / backward
-         * subsitution to solve the quadratic form and calculate the rss
+         * for larger m, we use the cholesky decompoistion and forward /
+         * backward subsitution to solve the quadratic form and calculate the
+         * rss
          */
         int err = calc_cholesky_decomposition(cov_xx, m);
         if (err)
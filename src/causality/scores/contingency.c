@@ -0,0 +1,341 @@
+/*
+ * contingency.c builds sparse contingency tables for the discrete scores. A
+ * dense table has a cell for every state of the parents of y, and the number
+ * of those states is the product of the parents' cardinalities, which quickly
+ * outgrows both the number of observations and an int. At most nobs cells
+ * are nonzero, so for large parent sets the observations are instead sorted
+ * by the states of the parents and y (with a radix sort, one counting sort per
+ * variable), which puts the observations of every nonzero cell next to each
+ * other, and the cells of every row next to each other.
+ *
+ * contingency_tables builds the pair of tables the discrete score differences
+ * need, dense or sparse, from whichever source of counts is available, so
+ * the scores only differ in how they score a table.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <dataframe.h>
+#include <causality.h>
+#include <scores/contingency.h>
+#include <data/adtree.h>
+
+/*
+ * parent_states returns the number of states of the parents xy[0], ...,
+ * xy[npar - 1], as a double so it cannot overflow.
+ */
+double parent_states(struct dataframe *df, int *xy, int npar)
+{
+    double n_x_states = 1.0;
+    for (int i = 0; i < npar; ++i)
+        n_x_states *= df->states[xy[i]];
+    return n_x_states;
+}
+
+/*
+ * use_sparse_table returns whether the contingency table of y = xy[npar] and
+ * its parents xy[0], ..., xy[npar - 1] should be sparse.
+ */
+int use_sparse_table(struct dataframe *df, int *xy, int npar)
+{
+    double cells = parent_states(df, xy, npar) * (df->states[xy[npar]] + 1);
+    return cells > INT_MAX || cells > (double) SPARSE_TABLE_RATIO * df->nobs;
+}
+
+static int alloc_contingency_table(struct contingency_table *ct, int nobs)
+{
+    memset(ct, 0, sizeof(struct contingency_table));
+    ct->n_j = malloc(3 * (nobs + 1) * sizeof(int));
+    if (ct->n_j == NULL)
+        return -1;
+    ct->n_jk    = ct->n_j  + nobs + 1;
+    ct->row_end = ct->n_jk + nobs + 1;
+    return 0;
+}
+
+void free_contingency_table(struct contingency_table *ct)
+{
+    free(ct->n_j);
+    memset(ct, 0, sizeof(struct contingency_table));
+}
+
+/*
+ * sort_observations returns the observations of df sorted by the states of
+ * the variables in cols, with cols[0] the most significant. Returns NULL if
+ * it runs out of memory.
+ */
+static int * sort_observations(struct dataframe *df, int *cols, int ncols)
+{
+    int nobs      = df->nobs;
+    int max_state = 1;
+    for (int c = 0; c < ncols; ++c) {
+        if (df->states[cols[c]] > max_state)
+            max_state = df->states[cols[c]];
+    }
+    int *order  = malloc((nobs + 1) * sizeof(int));
+    int *tmp    = malloc((nobs + 1) * sizeof(int));
+    int *counts = malloc((max_state + 1) * sizeof(int));
+    if (!order || !tmp || !counts) {
+        free(order);
+        free(tmp);
+        free(counts);
+        return NULL;
+    }
+    for (int i = 0; i < nobs; ++i)
+        order[i] = i;
+    /* least significant variable first, as each counting sort is stable */
+    for (int c = ncols - 1; c >= 0; --c) {
+        int *col      = df->df[cols[c]];
+        int  n_states = df->states[cols[c]];
+        memset(counts, 0, (n_states + 1) * sizeof(int));
+        for (int i = 0; i < nobs; ++i)
+            counts[col[i] + 1]++;
+        for (int s = 0; s < n_states; ++s)
+            counts[s + 1] += counts[s];
+        for (int i = 0; i < nobs; ++i)
+            tmp[counts[col[order[i]]]++] = order[i];
+        int *swap = order;
+        order     = tmp;
+        tmp       = swap;
+    }
+    free(tmp);
+    free(counts);
+    return order;
+}
+
+/*
+ * differs returns whether observations i and j differ in any of the n
+ * variables in data.
+ */
+static int differs(int **data, int n, int i, int j)
+{
+    for (int k = 0; k < n; ++k) {
+        if (data[k][i] != data[k][j])
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * sparse_contingency_table counts the states of y = xy[npar] for each state of
+ * its parents xy[0], ..., xy[npar - 1] into ct. Returns nonzero on failure.
+ */
+int sparse_contingency_table(struct dataframe *df, int *xy, int npar,
+                                 struct contingency_table *ct)
+{
+    int *order = sort_observations(df, xy, npar + 1);
+    if (order == NULL || alloc_contingency_table(ct, df->nobs)) {
+        CAUSALITY_ERROR("Failed to allocate a sparse contingency table\n");
+        free(order);
+        return -1;
+    }
+    int *data[npar + 1];
+    for (int i = 0; i < npar + 1; ++i)
+        data[i] = df->df[xy[i]];
+    int *y = data[npar];
+    for (int k = 0; k < df->nobs; ++k) {
+        int i = order[k];
+        int w = df->weights ? df->weights[i] : 1;
+        int new_row  = k == 0 || differs(data, npar, i, order[k - 1]);
+        int new_cell = new_row || y[i] != y[order[k - 1]];
+        if (new_row)
+            ct->n_j[ct->n_rows++] = 0;
+        if (new_cell)
+            ct->n_jk[ct->n_cells++] = 0;
+        ct->n_j[ct->n_rows - 1]     += w;
+        ct->n_jk[ct->n_cells - 1]   += w;
+        ct->row_end[ct->n_rows - 1]  = ct->n_cells;
+        ct->n                       += w;
+    }
+    free(order);
+    return 0;
+}
+
+/*
+ * end_minus_row adds the counts of y in the current row of minus, which are
+ * stored in y_counts for the n_touched states in touched, and resets them.
+ */
+static void end_minus_row(struct contingency_table *minus, int *y_counts,
+                              int *touched, int n_touched)
+{
+    for (int t = 0; t < n_touched; ++t) {
+        minus->n_jk[minus->n_cells++] = y_counts[touched[t]];
+        y_counts[touched[t]]          = 0;
+    }
+    minus->row_end[minus->n_rows - 1] = minus->n_cells;
+}
+
+/*
+ * sparse_contingency_tables counts the states of y = xy[npar + 1] for each
+ * state of its parents xy[1], ..., xy[npar] into minus, and for each state of
+ * x = xy[0] and its parents into plus. Both tables come from one sort of the
+ * observations, by the parents, then x, then y, so the observations with the
+ * same parents (a row of minus) are together, and within them those with the
+ * same x (a row of plus). Returns nonzero on failure.
+ */
+int sparse_contingency_tables(struct dataframe *df, int *xy, int npar,
+                                  struct contingency_table *plus,
+                                  struct contingency_table *minus)
+{
+    int cols[npar + 2];
+    for (int i = 0; i < npar; ++i)
+        cols[i] = xy[i + 1];
+    cols[npar]     = xy[0];
+    cols[npar + 1] = xy[npar + 1];
+    int n_y_states = df->states[xy[npar + 1]];
+    int *order     = sort_observations(df, cols, npar + 2);
+    int *y_counts  = calloc(2 * n_y_states, sizeof(int));
+    int *touched   = y_counts + n_y_states;
+    memset(plus, 0, sizeof(struct contingency_table));
+    memset(minus, 0, sizeof(struct contingency_table));
+    if (!order || !y_counts || alloc_contingency_table(plus, df->nobs) ||
+            alloc_contingency_table(minus, df->nobs)) {
+        CAUSALITY_ERROR("Failed to allocate a sparse contingency table\n");
+        free(order);
+        free(y_counts);
+        free_contingency_table(plus);
+        free_contingency_table(minus);
+        return -1;
+    }
+    int *data[npar + 2];
+    for (int i = 0; i < npar + 2; ++i)
+        data[i] = df->df[cols[i]];
+    int *x         = data[npar];
+    int *y         = data[npar + 1];
+    int  n_touched = 0;
+    for (int k = 0; k < df->nobs; ++k) {
+        int i    = order[k];
+        int prev = k ? order[k - 1] : 0;
+        int w    = df->weights ? df->weights[i] : 1;
+        int new_par  = k == 0 || differs(data, npar, i, prev);
+        int new_row  = new_par || x[i] != x[prev];
+        int new_cell = new_row || y[i] != y[prev];
+        if (new_par) {
+            if (k)
+                end_minus_row(minus, y_counts, touched, n_touched);
+            n_touched = 0;
+            minus->n_j[minus->n_rows++] = 0;
+        }
+        if (new_row)
+            plus->n_j[plus->n_rows++] = 0;
+        if (new_cell)
+            plus->n_jk[plus->n_cells++] = 0;
+        if (y_counts[y[i]] == 0)
+            touched[n_touched++] = y[i];
+        plus->n_j[plus->n_rows - 1]     += w;
+        plus->n_jk[plus->n_cells - 1]   += w;
+        plus->row_end[plus->n_rows - 1]  = plus->n_cells;
+        minus->n_j[minus->n_rows - 1]   += w;
+        y_counts[y[i]]                  += w;
+        plus->n                         += w;
+    }
+    if (df->nobs)
+        end_minus_row(minus, y_counts, touched, n_touched);
+    minus->n = plus->n;
+    free(order);
+    free(y_counts);
+    return 0;
+}
+
+/*
+ * count_dense_tables counts the dense table of y = xy[npar + 1] and x = xy[0]
+ * plus its parents xy[1], ..., xy[npar] into ct, from the adtree of df if it
+ * has one, and from its rows otherwise. The counts of x and y may already
+ * have been taken by the caller, as n_xy, when y has no other parents; the
+ * table then points to them instead of a copy.
+ */
+static void count_dense_tables(struct dataframe *df, int *xy, int npar,
+                                   int *n_xy, struct contingency_tables *ct)
+{
+    int n_y_states = df->states[xy[npar + 1]];
+    int n_x_states = ct->plus_states;
+    if (n_xy) {
+        ct->plus_jk = n_xy;
+        for (int j = 0; j < n_x_states; ++j) {
+            for (int k = 0; k < n_y_states; ++k)
+                ct->plus_j[j] += n_xy[j * n_y_states + k];
+        }
+    }
+    else if (!df->adtree || adtree_counts(df->adtree, xy, npar + 2,
+                                              ct->plus_jk, ct->plus_j)) {
+        /* local copies, so the stores to the counts do not force reloads */
+        int *data[npar + 2];
+        int  par_states[npar + 1];
+        for (int i = 0; i < npar + 2; ++i)
+            data[i] = df->df[xy[i]];
+        for (int i = 0; i < npar; ++i)
+            par_states[i] = df->states[xy[i + 1]];
+        int *y       = data[npar + 1];
+        int *plus_jk = ct->plus_jk;
+        int *plus_j  = ct->plus_j;
+        int *weights = df->weights;
+        for (int i = 0; i < df->nobs; ++i) {
+            int w = weights ? weights[i] : 1;
+            int k = data[0][i];
+            for (int j = 0; j < npar; ++j)
+                k = k * par_states[j] + data[j + 1][i];
+            plus_jk[k * n_y_states + y[i]] += w;
+            plus_j[k] += w;
+        }
+    }
+    for (int j = 0; j < n_x_states; ++j)
+        ct->n += ct->plus_j[j];
+}
+
+/*
+ * contingency_tables builds the tables of y = xy[npar + 1] with and without
+ * x = xy[0] in its parents xy[1], ..., xy[npar] into ct. If y has no other
+ * parents (npar is 0), n_xy may hold the counts of x and y, which are used
+ * instead of counting again. The table without x is found by summing x out
+ * of the table with it: since x is the most significant, that adds up its
+ * blocks. Returns nonzero on failure.
+ */
+int contingency_tables(struct dataframe *df, int *xy, int npar, int *n_xy,
+                           struct contingency_tables *ct)
+{
+    memset(ct, 0, sizeof(struct contingency_tables));
+    ct->plus_states  = parent_states(df, xy, npar + 1);
+    ct->minus_states = parent_states(df, xy + 1, npar);
+    if (use_sparse_table(df, xy, npar + 1)) {
+        ct->sparse = 1;
+        if (sparse_contingency_tables(df, xy, npar, &ct->plus, &ct->minus))
+            return -1;
+        ct->n = ct->plus.n;
+        return 0;
+    }
+    int n_y_states   = df->states[xy[npar + 1]];
+    int n_x_states   = ct->plus_states;
+    int n_par_states = ct->minus_states;
+    ct->mem = calloc((n_x_states + n_par_states) * (n_y_states + 1),
+                         sizeof(int));
+    if (!ct->mem) {
+        CAUSALITY_ERROR("Failed to allocate a contingency table\n");
+        return -1;
+    }
+    ct->plus_jk  = ct->mem;
+    ct->plus_j   = ct->plus_jk + n_x_states * n_y_states;
+    ct->minus_jk = ct->plus_j + n_x_states;
+    ct->minus_j  = ct->minus_jk + n_par_states * n_y_states;
+    count_dense_tables(df, xy, npar, npar ? NULL : n_xy, ct);
+    for (int a = 0; a < df->states[xy[0]]; ++a) {
+        int *block_jk = ct->plus_jk + a * n_par_states * n_y_states;
+        int *block_j  = ct->plus_j  + a * n_par_states;
+        for (int k = 0; k < n_par_states * n_y_states; ++k)
+            ct->minus_jk[k] += block_jk[k];
+        for (int k = 0; k < n_par_states; ++k)
+            ct->minus_j[k] += block_j[k];
+    }
+    return 0;
+}
+
+void free_contingency_tables(struct contingency_tables *ct)
+{
+    if (ct->sparse) {
+        free_contingency_table(&ct->plus);
+        free_contingency_table(&ct->minus);
+    }
+    free(ct->mem);
+    memset(ct, 0, sizeof(struct contingency_tables));
+}
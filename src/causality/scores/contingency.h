@@ -0,0 +1,62 @@
+#ifndef CONTINGENCY_H
+#define CONTINGENCY_H
+
+#include <dataframe.h>
+
+/*
+ * A dense contingency table has a cell for every state of the parents and y,
+ * which is only sensible when there are not many more cells than observations.
+ * Past SPARSE_TABLE_RATIO cells per observation, the sparse tables below are
+ * used instead.
+ */
+#define SPARSE_TABLE_RATIO 4
+
+/*
+ * contingency_table stores the nonzero cells of a contingency table of y and
+ * its parents. The cells are grouped by the state of the parents: the counts
+ * of row j are n_jk[row_end[j - 1]], ..., n_jk[row_end[j] - 1], and their sum
+ * is n_j[j]. n is the sum of all of the counts.
+ */
+struct contingency_table {
+    int     n_rows;
+    int     n_cells;
+    int    *n_j;
+    int    *n_jk;
+    int    *row_end;
+    double  n;
+};
+
+/*
+ * contingency_tables holds the tables of y with x added to its parents (plus)
+ * and without it (minus), which the score differences compare. Small tables
+ * are dense: plus_jk has a row for each state of x and the parents, with x
+ * the most significant, and minus_jk a row for each state of the parents,
+ * and n_j are their row sums. Otherwise the tables are sparse, in plus and
+ * minus. plus_states and minus_states are the number of rows either way.
+ */
+struct contingency_tables {
+    int     sparse;
+    struct contingency_table plus;
+    struct contingency_table minus;
+    int    *plus_jk;
+    int    *plus_j;
+    int    *minus_jk;
+    int    *minus_j;
+    double  plus_states;
+    double  minus_states;
+    double  n;
+    int    *mem;
+};
+
+double parent_states(struct dataframe *df, int *xy, int npar);
+int  use_sparse_table(struct dataframe *df, int *xy, int npar);
+int  sparse_contingency_table(struct dataframe *df, int *xy, int npar,
+                                  struct contingency_table *ct);
+int  sparse_contingency_tables(struct dataframe *df, int *xy, int npar,
+                                   struct contingency_table *plus,
+                                   struct contingency_table *minus);
+void free_contingency_table(struct contingency_table *ct);
+int  contingency_tables(struct dataframe *df, int *xy, int npar, int *n_xy,
+                            struct contingency_tables *ct);
+void free_contingency_tables(struct contingency_tables *ct);
+#endif
@@ -4,9 +4,58 @@
 #include <dataframe.h>
 #include <causality.h>
 #include <scores/scores.h>
+#include <scores/contingency.h>
+#include <scores/score_cache.h>
+#include <data/adtree.h>
 
 #define EPSILON 1e-6
 
+/*
+ * bic_table_score scores the counts n_jk of the n_y_states states of y for each
+ * of the n_x_states states of its parents, where n_j are the row sums of n_jk
+ * and n is the number of observations.
+ */
+static double bic_table_score(int *n_jk, int *n_j, int n_x_states,
+                                  int n_y_states, double n, double penalty,
+                                  struct score_cache *cache)
+{
+    double lik = 0.0;
+    /* sum n_jk log(n_jk / n_j) as sum n_jk log n_jk - sum n_j log n_j */
+    if (cache)
+        lik = sum_klogk(cache, n_jk, n_x_states * n_y_states) -
+                  sum_klogk(cache, n_j, n_x_states);
+    for (int j = 0; j < n_x_states && !cache; ++j)
+        for (int k = 0; k < n_y_states; ++k)
+            if (n_jk[j * n_y_states + k])
+                lik += n_jk[j * n_y_states + k ] *
+                         log(n_jk[j * n_y_states + k] / (double) n_j[j]);
+
+    double params = n_x_states * (n_y_states - 1);
+    return -2.0 * lik + penalty * params * log(n) + EPSILON;
+}
+
+/*
+ * bic_sparse_table_score is bic_table_score for a sparse table, whose empty
+ * cells add nothing to the likelihood.
+ */
+static double bic_sparse_table_score(struct contingency_table *ct,
+                                         double n_x_states, int n_y_states,
+                                         double penalty,
+                                         struct score_cache *cache)
+{
+    double lik = 0.0;
+    int    k   = 0;
+    if (cache)
+        lik = sum_klogk(cache, ct->n_jk, ct->n_cells) -
+                  sum_klogk(cache, ct->n_j, ct->n_rows);
+    for (int j = 0; j < ct->n_rows && !cache; ++j)
+        for (; k < ct->row_end[j]; ++k)
+            if (ct->n_jk[k])
+                lik += ct->n_jk[k] * log(ct->n_jk[k] / (double) ct->n_j[j]);
+
+    double params = n_x_states * (n_y_states - 1);
+    return -2.0 * lik + penalty * params * log(ct->n) + EPSILON;
+}
 
 double discrete_bic_score(struct dataframe *df, int *xy, int npar,
                             struct score_args *args)
@@ -20,6 +69,17 @@ double discrete_bic_score(struct dataframe *df, int *xy, int npar,
 
     int *y          = data[npar];
     int  n_y_states = df->states[xy[npar]];
+
+    if (use_sparse_table(df, xy, npar)) {
+        struct contingency_table ct;
+        if (sparse_contingency_table(df, xy, npar, &ct))
+            return 0.0;
+        double score = bic_sparse_table_score(&ct, parent_states(df, xy, npar),
+                                                  n_y_states, penalty,
+                                                  args->cache);
+        free_contingency_table(&ct);
+        return score;
+    }
     /* get the number of states for each x */
     int x_states[npar];
     for(int i = 0; i < npar; ++i)
@@ -42,7 +102,14 @@ double discrete_bic_score(struct dataframe *df, int *xy, int npar,
 
     int *n_jk = alloced_mem;
     int *n_j  = alloced_mem + n_x_states * n_y_states;
-    for (int i = 0; i < df->nobs; ++i) {
+    double n  = 0.0f;
+    /* count from the adtree if there is one, otherwise from the rows */
+    int counted = df->adtree && !adtree_counts(df->adtree, xy, npar + 1, n_jk,
+                                                   n_j);
+    for (int j = 0; j < n_x_states && counted; ++j)
+        n += n_j[j];
+    for (int i = 0; i < df->nobs && !counted; ++i) {
+        int w = df->weights ? df->weights[i] : 1;
         /* convert the state of x into an index (i.e. k) for n_jk */
         int k = 0;
         for (int j = 0; j < npar; ++j) {
@@ -50,21 +117,72 @@ double discrete_bic_score(struct dataframe *df, int *xy, int npar,
             k = k * x_states[j] + data[j][i];
         }
 
-        /* increment the observed microstate (x,y) by 1 in n_jk */
-        n_jk[k * n_y_states + y[i]]++;
-        /* increment observed microstate (y) by 1 in n_j */
-        n_j[k]++;
+        /* increment the observed microstate (x,y) by w in n_jk */
+        n_jk[k * n_y_states + y[i]] += w;
+        /* increment observed microstate (y) by w in n_j */
+        n_j[k] += w;
+        n      += w;
     }
+    double score = bic_table_score(n_jk, n_j, n_x_states, n_y_states, n,
+                                       penalty, args->cache);
+    free(alloced_mem);
+    return score;
+}
 
-    double lik = 0.0;
-    for (int j = 0; j < n_x_states; ++j)
-        for (int k = 0; k < n_y_states; ++k)
-            if (n_jk[j * n_y_states + k])
-                lik += n_jk[j * n_y_states + k ] *
-                         log(n_jk[j * n_y_states + k] / (double) n_j[j]);
+/*
+ * discrete_bic_tables_score_diff scores the tables of y with and without x,
+ * built by contingency_tables from xy, npar, and n_xy, and returns the
+ * difference.
+ */
+static double discrete_bic_tables_score_diff(struct dataframe *df, int *xy,
+                                                 int npar, int *n_xy,
+                                                 struct score_args *args)
+{
+    struct contingency_tables ct;
+    if (contingency_tables(df, xy, npar, n_xy, &ct))
+        return 0.0;
+    double penalty    = args->fargs[0];
+    int    n_y_states = df->states[xy[npar + 1]];
+    double score_plus, score_minus;
+    if (ct.sparse) {
+        score_plus  = bic_sparse_table_score(&ct.plus, ct.plus_states,
+                                                 n_y_states, penalty,
+                                                 args->cache);
+        score_minus = bic_sparse_table_score(&ct.minus, ct.minus_states,
+                                                 n_y_states, penalty,
+                                                 args->cache);
+    }
+    else {
+        score_plus  = bic_table_score(ct.plus_jk, ct.plus_j, ct.plus_states,
+                                          n_y_states, ct.n, penalty,
+                                          args->cache);
+        score_minus = bic_table_score(ct.minus_jk, ct.minus_j,
+                                          ct.minus_states, n_y_states, ct.n,
+                                          penalty, args->cache);
+    }
+    free_contingency_tables(&ct);
+    return score_plus - score_minus;
+}
 
-    double params = n_x_states * (n_y_states - 1);
-    free(alloced_mem);
+/*
+ * discrete_bic_score_diff returns the difference in the discrete BIC score of
+ * y made by adding x to its parents. xy holds x, the npar parents of y, and y.
+ */
+double discrete_bic_score_diff(struct dataframe *df, int *xy, int npar,
+                                   struct score_args *args)
+{
+    return discrete_bic_tables_score_diff(df, xy, npar, NULL, args);
+}
 
-    return -2.0 * lik + penalty * params * log(df->nobs) + EPSILON;
+/*
+ * discrete_bic_pair_score_diff is discrete_bic_score_diff for adding x to the
+ * parents of y when y has no other parents, scored from the counts n_xy of
+ * the states of x and y that the caller already took, with x the most
+ * significant.
+ */
+double discrete_bic_pair_score_diff(struct dataframe *df, int x, int y,
+                                        int *n_xy, struct score_args *args)
+{
+    int xy[2] = {x, y};
+    return discrete_bic_tables_score_diff(df, xy, 0, n_xy, args);
 }
@@ -14,7 +14,21 @@
 
 #include <math.h>
 
-#define EPSILON 1e-9
+#include <stddef.h>
+
+#include <scores/linearalgebra.h>
+
+#define EPSILON         1e-9
+#define NORMALIZE_LANES 8
+
+/* the columns of a dataframe are aligned to (at least) 32 bytes */
+#ifdef __GNUC__
+#define ASSUME_ALIGNED(x) __builtin_assume_aligned((x), 32)
+#define ALWAYS_INLINE     inline __attribute__((always_inline))
+#else
+#define ASSUME_ALIGNED(x) (x)
+#define ALWAYS_INLINE     inline
+#endif
 
 /*
  * calc_covariance_xy calculates the covariance between the random variable y
@@ -23,16 +37,10 @@
 void calc_covariance_xy(double * restrict cov, double **x, double *y, int n,
                             int m)
 {
-    #ifndef  _WIN32
-    y = __builtin_assume_aligned(y, 32);
-    #endif
+    y = ASSUME_ALIGNED(y);
     double inv_nm1 = 1.0f / (n - 1.0f);
     for (int i = 0; i < m; ++i) {
-        #ifndef _WIN32
-        double *x_i = __builtin_assume_aligned(x[i], 32);
-        #else
-        double *x_i = x[i];
-        #endif
+        double *x_i = ASSUME_ALIGNED(x[i]);
         double sum = 0.0f;
         for (int j = 0; j < n; ++j)
             sum += x_i[j] * y[j];
@@ -42,35 +50,141 @@ void calc_covariance_xy(double * restrict cov, double **x, double *y, int n,
 
 /*
  * calc_covariance_matrix calculates the covariance matrix of the
- * n x m dataset x.
+ * n x m dataset x. Only the upper triangle is calculated, but both triangles
+ * are filled in since callers index the matrix in either order.
  */
 void calc_covariance_matrix(double * restrict cov, double **x, int n, int m)
 {
     double inv_nm1 = 1.0f / (n - 1.0f);
     for (int i = 0; i < m; ++i) {
-        #ifndef _WIN32
-        double *x_i =  __builtin_assume_aligned(x[i], 32);
-        #else
-        double *x_i = x[i];
-        #endif
+        double *x_i = ASSUME_ALIGNED(x[i]);
         for (int j = i; j < m; ++j) {
             if (i == j)
                 cov[j + m * i] = 1.0f;
             else {
-                #ifndef _WIN32
-                double *x_j =  __builtin_assume_aligned(x[j], 32);
-                #else
-                double *x_j =  x[j];
-                #endif
+                double *x_j = ASSUME_ALIGNED(x[j]);
                 double sum = 0.0f;
                 for (int k = 0; k < n; ++k)
                     sum += x_i[k] * x_j[k];
                 cov[j + m * i] = sum * inv_nm1;
+                cov[i + m * j] = cov[j + m * i];
             }
         }
     }
 }
 
+/*
+ * calc_cross_products_block adds the cross products between x[i] and x[j],
+ * for j = i ... m - 1, over the rows start ... end - 1 to sums_i[j]. Calling
+ * it for consecutive blocks of rows accumulates row i of the (unscaled)
+ * covariance matrix while only touching one block of the data at a time.
+ */
+void calc_cross_products_block(double * restrict sums_i, double **x, int i,
+                                   int m, int start, int end)
+{
+    double *x_i = x[i] + start;
+    int     n   = end - start;
+    for (int j = i; j < m; ++j) {
+        double *x_j = x[j] + start;
+        double sum  = 0.0f;
+        for (int k = 0; k < n; ++k)
+            sum += x_i[k] * x_j[k];
+        sums_i[j] += sum;
+    }
+}
+
+/*
+ * calc_cross_products_tile adds the cross products between x[i] and x[j], for
+ * i0 <= i < i1 and j0 <= j < j1 with j > i, over the rows start ... end - 1 to
+ * cov[i * ld + j]. The tiles of variables are chosen so that their blocks of
+ * rows stay in cache while every pair between them is summed; each x[i] is
+ * loaded once for four x[j].
+ */
+void calc_cross_products_tile(double * restrict cov, double **x, size_t ld,
+                                  int i0, int i1, int j0, int j1, int start,
+                                  int end)
+{
+    int n = end - start;
+    for (int i = i0; i < i1; ++i) {
+        double *x_i   = x[i] + start;
+        double *cov_i = cov + i * ld;
+        int     j     = j0 > i + 1 ? j0 : i + 1;
+        for (; j + 4 <= j1; j += 4) {
+            double *x_0 = x[j] + start;
+            double *x_1 = x[j + 1] + start;
+            double *x_2 = x[j + 2] + start;
+            double *x_3 = x[j + 3] + start;
+            double  s_0 = 0.0f, s_1 = 0.0f, s_2 = 0.0f, s_3 = 0.0f;
+            for (int k = 0; k < n; ++k) {
+                s_0 += x_i[k] * x_0[k];
+                s_1 += x_i[k] * x_1[k];
+                s_2 += x_i[k] * x_2[k];
+                s_3 += x_i[k] * x_3[k];
+            }
+            cov_i[j]     += s_0;
+            cov_i[j + 1] += s_1;
+            cov_i[j + 2] += s_2;
+            cov_i[j + 3] += s_3;
+        }
+        for (; j < j1; ++j) {
+            double *x_j = x[j] + start;
+            double  sum = 0.0f;
+            for (int k = 0; k < n; ++k)
+                sum += x_i[k] * x_j[k];
+            cov_i[j] += sum;
+        }
+    }
+}
+
+/*
+ * calc_normalized_copy copies the n values in src to x, normalized to have
+ * mean 0 and variance 1. The mean and variance are accumulated while copying,
+ * with Welford's update run in NORMALIZE_LANES interleaved lanes so the loop
+ * vectorizes, and the lanes are merged with Chan's formula. A second pass
+ * then centers and scales x, instead of the three passes of computing the
+ * mean, the variance, and scaling.
+ */
+void calc_normalized_copy(double * restrict x, const double * restrict src,
+                              int n)
+{
+    double mean[NORMALIZE_LANES] = {0.0f};
+    double m2[NORMALIZE_LANES]   = {0.0f};
+    int n_blocks = n / NORMALIZE_LANES;
+    for (int b = 0; b < n_blocks; ++b) {
+        const double *src_b = src + (size_t) b * NORMALIZE_LANES;
+        double       *x_b   = x + (size_t) b * NORMALIZE_LANES;
+        double inv_k = 1.0f / (b + 1.0f);
+        for (int l = 0; l < NORMALIZE_LANES; ++l) {
+            double v     = src_b[l];
+            double delta = v - mean[l];
+            x_b[l]   = v;
+            mean[l] += delta * inv_k;
+            m2[l]   += delta * (v - mean[l]);
+        }
+    }
+    double count = 0.0f;
+    double mu    = 0.0f;
+    double ss    = 0.0f;
+    for (int l = 0; l < NORMALIZE_LANES && n_blocks; ++l) {
+        double total = count + n_blocks;
+        double delta = mean[l] - mu;
+        mu   += delta * n_blocks / total;
+        ss   += m2[l] + delta * delta * count * n_blocks / total;
+        count = total;
+    }
+    for (int i = n_blocks * NORMALIZE_LANES; i < n; ++i) {
+        double v     = src[i];
+        double delta = v - mu;
+        x[i]   = v;
+        count += 1.0f;
+        mu    += delta / count;
+        ss    += delta * (v - mu);
+    }
+    double scale = 1 / sqrt(ss / (n - 1));
+    for (int i = 0; i < n; ++i)
+        x[i] = (x[i] - mu) * scale;
+}
+
 /*
  * calc_cholesky_decomposition calculates the lower trianglular cholesky
  * decomposition for the given m x m covariance matrix. m is assumed >= 3
@@ -123,3 +237,136 @@ double calc_quadratic_form(double * restrict cov_xy, double *cov_xy_t,
     }
     return sum;
 }
+
+/*
+ * small_quadratic_form is calc_cholesky_decomposition followed by
+ * calc_quadratic_form for a small m, which the kernels below fix at compile
+ * time so that the loops can be unrolled. The factor is stored packed, row by
+ * row, so the inner products run over contiguous memory, and the quadratic
+ * form is the squared norm of chol^-1 cov_xy, which only needs the forward
+ * substitution. Neither input is modified.
+ */
+static ALWAYS_INLINE int small_quadratic_form(const double * restrict cov_xx,
+                                                  const double * restrict cov_xy,
+                                                  const int m, double *form)
+{
+    double l[SMALL_KERNEL_MAX * (SMALL_KERNEL_MAX + 1) / 2];
+    double z[SMALL_KERNEL_MAX];
+    /* as in calc_cholesky_decomposition, the first column is cov_xx's */
+    for (int i = 0; i < m; ++i)
+        l[i * (i + 1) / 2] = cov_xx[i];
+    for (int j = 1; j < m; ++j) {
+        double *l_j  = l + j * (j + 1) / 2;
+        double  l_jj = 1.0f + EPSILON;
+        for (int k = 0; k < j; ++k)
+            l_jj -= l_j[k] * l_j[k];
+        if (l_jj < 0.0f)
+            return j;
+        l_jj   = sqrt(l_jj);
+        l_j[j] = l_jj;
+        l_jj   = 1.0f / l_jj;
+        for (int i = j + 1; i < m; ++i) {
+            double *l_i = l + i * (i + 1) / 2;
+            double  s   = cov_xx[m * j + i];
+            for (int k = 0; k < j; ++k)
+                s -= l_j[k] * l_i[k];
+            l_i[j] = s * l_jj;
+        }
+    }
+    double sum = 0.0f;
+    for (int i = 0; i < m; ++i) {
+        double *l_i = l + i * (i + 1) / 2;
+        double  s   = cov_xy[i];
+        for (int j = 0; j < i; ++j)
+            s -= l_i[j] * z[j];
+        z[i] = s / l_i[i];
+        sum += z[i] * z[i];
+    }
+    *form = sum;
+    return 0;
+}
+
+#define SMALL_KERNEL(M)                                                      \
+    static int small_quadratic_form_##M(const double *cov_xx,                \
+                                            const double *cov_xy,            \
+                                            double *form)                    \
+    {                                                                        \
+        return small_quadratic_form(cov_xx, cov_xy, M, form);                \
+    }
+
+SMALL_KERNEL(3)  SMALL_KERNEL(4)  SMALL_KERNEL(5)  SMALL_KERNEL(6)
+SMALL_KERNEL(7)  SMALL_KERNEL(8)  SMALL_KERNEL(9)  SMALL_KERNEL(10)
+SMALL_KERNEL(11) SMALL_KERNEL(12) SMALL_KERNEL(13) SMALL_KERNEL(14)
+SMALL_KERNEL(15) SMALL_KERNEL(16)
+
+typedef int (*small_kernel)(const double *cov_xx, const double *cov_xy,
+                                double *form);
+
+static const small_kernel small_kernels[SMALL_KERNEL_MAX + 1] = {
+    NULL, NULL, NULL,
+    small_quadratic_form_3,  small_quadratic_form_4,  small_quadratic_form_5,
+    small_quadratic_form_6,  small_quadratic_form_7,  small_quadratic_form_8,
+    small_quadratic_form_9,  small_quadratic_form_10, small_quadratic_form_11,
+    small_quadratic_form_12, small_quadratic_form_13, small_quadratic_form_14,
+    small_quadratic_form_15, small_quadratic_form_16
+};
+
+/*
+ * calc_small_quadratic_form calculates cov_xy^T cov_xx^-1 cov_xy into form for
+ * 3 <= m <= SMALL_KERNEL_MAX, using the kernel specialized for m. Returns the
+ * order of the first leading minor that is not positive, like
+ * calc_cholesky_decomposition, or 0.
+ */
+int calc_small_quadratic_form(const double *cov_xx, const double *cov_xy,
+                                  int m, double *form)
+{
+    return small_kernels[m](cov_xx, cov_xy, form);
+}
+
+/*
+ * calc_rss_reductions scores many candidate regressors at once: given the
+ * cholesky decomposition chol of the covariance matrix of the m regressors
+ * z, the covariances cov_zy between z and the response y, the covariances v
+ * between z and the n candidates x (m rows of n, row major) and the
+ * covariances cov_xy between the candidates and y, it stores in reductions[c]
+ * how much adding x_c to z reduces the rss of y, and returns the rss of y
+ * regressed on z. The triangular solves for all candidates are done together,
+ * row by row, so each entry of chol is loaded once. cov_zy and v are
+ * overwritten.
+ */
+double calc_rss_reductions(double * restrict reductions, double * restrict v,
+                               double * restrict cov_zy,
+                               const double * restrict cov_xy,
+                               const double * restrict chol, int m, int n)
+{
+    double rss = 1.0f;
+    for (int i = 0; i < m; ++i) {
+        const double *chol_i = chol + i;
+        double       *v_i    = v + (size_t) i * n;
+        double        s      = cov_zy[i];
+        for (int j = 0; j < i; ++j) {
+            double  l_ij = chol_i[m * j];
+            double *v_j  = v + (size_t) j * n;
+            s -= l_ij * cov_zy[j];
+            for (int c = 0; c < n; ++c)
+                v_i[c] -= l_ij * v_j[c];
+        }
+        double inv_l_ii = 1.0f / chol_i[m * i];
+        cov_zy[i] = s * inv_l_ii;
+        rss      -= cov_zy[i] * cov_zy[i];
+        for (int c = 0; c < n; ++c)
+            v_i[c] *= inv_l_ii;
+    }
+    /* the partial covariance of x_c and y, and the partial variance of x_c */
+    for (int c = 0; c < n; ++c) {
+        double cov = cov_xy[c];
+        double var = 1.0f;
+        for (int i = 0; i < m; ++i) {
+            double b = v[(size_t) i * n + c];
+            cov -= b * cov_zy[i];
+            var -= b * b;
+        }
+        reductions[c] = var > 0.0f ? cov * cov / var : 0.0f;
+    }
+    return rss;
+}
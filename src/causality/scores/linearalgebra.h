@@ -1,10 +1,25 @@
 #ifndef LINEARALGEBRA_H
 #define LINEARALGEBRA_H
 
+#define SMALL_KERNEL_MAX 16 /* largest m with a specialized kernel */
+
 void calc_covariance_xy(double *restrict cov_xy, double **x, double *y, int n,
                             int m);
 void calc_covariance_matrix(double * restrict cov, double **x, int n, int m);
+void calc_cross_products_block(double * restrict sums_i, double **x, int i,
+                                   int m, int start, int end);
+void calc_cross_products_tile(double * restrict cov, double **x, size_t ld,
+                                  int i0, int i1, int j0, int j1, int start,
+                                  int end);
+void calc_normalized_copy(double * restrict x, const double * restrict src,
+                              int n);
 int calc_cholesky_decomposition(double *cov, int m);
 double calc_quadratic_form(double * restrict cov_xy, double * restrict cov_xy_t,
                                double * restrict chol, int m);
+int calc_small_quadratic_form(const double *cov_xx, const double *cov_xy,
+                                  int m, double *form);
+double calc_rss_reductions(double * restrict reductions, double * restrict v,
+                               double * restrict cov_zy,
+                               const double * restrict cov_xy,
+                               const double * restrict chol, int m, int n);
 #endif
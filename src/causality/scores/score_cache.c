@@ -0,0 +1,140 @@
+/*
+ * score_cache.c implements the tables of the discrete scores. Most cells of a
+ * contingency table hold small counts, so their lgammas and k log k's are
+ * looked up. The counts past the tables are gathered into batches, which are
+ * evaluated with loops free of branches and library calls other than log, so
+ * they can be vectorized. Past SCORE_CACHE_COUNTS, Stirling's series
+ *
+ *     lgamma(x) = (x - 1/2) log x - x + log(2 pi) / 2
+ *                     + 1 / (12 x) - 1 / (360 x^3) + 1 / (1260 x^5) - ...
+ *
+ * is exact to double precision after three terms.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <causality.h>
+#include <scores/score_cache.h>
+
+#define BATCH_SIZE   64
+#define HALF_LOG_2PI 0.91893853320467274178
+
+struct score_cache * create_score_cache(void)
+{
+    struct score_cache *cache = calloc(1, sizeof(struct score_cache));
+    if (cache)
+        cache->klogk = malloc(SCORE_CACHE_COUNTS * sizeof(double));
+    if (!cache || !cache->klogk) {
+        CAUSALITY_ERROR("Failed to allocate memory for the score cache.\n");
+        free(cache);
+        return NULL;
+    }
+    cache->klogk[0] = 0.0;
+    for (int k = 1; k < SCORE_CACHE_COUNTS; ++k)
+        cache->klogk[k] = k * log(k);
+    return cache;
+}
+
+void free_score_cache(struct score_cache *cache)
+{
+    for (int i = 0; i < cache->n_alphas; ++i)
+        free(cache->lgammas[i]);
+    free(cache->klogk);
+    free(cache);
+}
+
+/*
+ * lgamma_table returns the table of lgamma(alpha + k), which is made the
+ * first time alpha is seen, or NULL if every slot is taken. The scores run in
+ * parallel, so the slots are searched and filled in a critical section; it is
+ * entered once per contingency table, not per cell.
+ */
+static const double * lgamma_table(struct score_cache *cache, double alpha)
+{
+    double *table = NULL;
+    #pragma omp critical (score_cache)
+    {
+        int i = 0;
+        while (i < cache->n_alphas && cache->alphas[i] != alpha)
+            i++;
+        if (i < cache->n_alphas)
+            table = cache->lgammas[i];
+        else if (i < SCORE_CACHE_SLOTS &&
+                     (table = malloc(SCORE_CACHE_COUNTS * sizeof(double)))) {
+            for (int k = 0; k < SCORE_CACHE_COUNTS; ++k)
+                table[k] = lgamma(alpha + k);
+            cache->alphas[i]  = alpha;
+            cache->lgammas[i] = table;
+            cache->n_alphas++;
+        }
+    }
+    return table;
+}
+
+static double stirling_batch(const double *x, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double r  = 1.0 / x[i];
+        double r2 = r * r;
+        sum += (x[i] - 0.5) * log(x[i]) - x[i] + HALF_LOG_2PI +
+                   r * (1.0 / 12.0 - r2 * (1.0 / 360.0 - r2 / 1260.0));
+    }
+    return sum;
+}
+
+static double klogk_batch(const double *x, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; ++i)
+        sum += x[i] * log(x[i]);
+    return sum;
+}
+
+/* sum_lgammas returns the sum of lgamma(alpha + counts[i]) */
+double sum_lgammas(struct score_cache *cache, double alpha, const int *counts,
+                       int n)
+{
+    const double *table = lgamma_table(cache, alpha);
+    double        sum   = 0.0;
+    if (!table) {
+        for (int i = 0; i < n; ++i)
+            sum += lgamma(alpha + counts[i]);
+        return sum;
+    }
+    double batch[BATCH_SIZE];
+    int    n_batch = 0;
+    for (int i = 0; i < n; ++i) {
+        if (counts[i] < SCORE_CACHE_COUNTS) {
+            sum += table[counts[i]];
+            continue;
+        }
+        batch[n_batch++] = alpha + counts[i];
+        if (n_batch == BATCH_SIZE) {
+            sum    += stirling_batch(batch, n_batch);
+            n_batch = 0;
+        }
+    }
+    return sum + stirling_batch(batch, n_batch);
+}
+
+/* sum_klogk returns the sum of counts[i] log counts[i] */
+double sum_klogk(struct score_cache *cache, const int *counts, int n)
+{
+    double batch[BATCH_SIZE];
+    int    n_batch = 0;
+    double sum     = 0.0;
+    for (int i = 0; i < n; ++i) {
+        if (counts[i] < SCORE_CACHE_COUNTS) {
+            sum += cache->klogk[counts[i]];
+            continue;
+        }
+        batch[n_batch++] = counts[i];
+        if (n_batch == BATCH_SIZE) {
+            sum    += klogk_batch(batch, n_batch);
+            n_batch = 0;
+        }
+    }
+    return sum + klogk_batch(batch, n_batch);
+}
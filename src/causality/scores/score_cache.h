@@ -0,0 +1,25 @@
+#ifndef SCORE_CACHE_H
+#define SCORE_CACHE_H
+
+#define SCORE_CACHE_COUNTS 4096 /* counts 0..SCORE_CACHE_COUNTS - 1 */
+#define SCORE_CACHE_SLOTS  256  /* priors with a table of lgammas   */
+
+/*
+ * score_cache tabulates the transcendental functions of counts that the
+ * discrete scores sum over their contingency tables: k log k for discrete
+ * BIC, and lgamma(alpha + k) for each prior alpha BDeu uses. Larger counts
+ * are computed in batches.
+ */
+struct score_cache {
+    double *klogk;
+    int     n_alphas;
+    double  alphas[SCORE_CACHE_SLOTS];
+    double *lgammas[SCORE_CACHE_SLOTS];
+};
+
+struct score_cache * create_score_cache(void);
+void   free_score_cache(struct score_cache *cache);
+double sum_lgammas(struct score_cache *cache, double alpha, const int *counts,
+                       int n);
+double sum_klogk(struct score_cache *cache, const int *counts, int n);
+#endif
@@ -7,9 +7,16 @@
 #define BDEU_SCORE "bdeu"
 #define DISCRETE_BIC_SCORE "discrete-bic"
 
+struct score_cache;
+
+/*
+ * If cache is not NULL, the discrete scores look their lgammas and logs up in
+ * it instead of computing them.
+ */
 struct score_args {
-    double *fargs;
-    int    *iargs;
+    double             *fargs;
+    int                *iargs;
+    struct score_cache *cache;
 };
 
 typedef double (*score_func)(struct dataframe *df, int *xy, int npar,
@@ -21,6 +28,18 @@ double bdeu_score(struct dataframe *df, int *xy, int npar,
 double discrete_bic_score(struct dataframe *df, int *xy, int npar,
                               struct score_args *args);
 
+double bdeu_score_diff(struct dataframe *df, int *xy, int npar,
+                           struct score_args *args);
+
+double discrete_bic_score_diff(struct dataframe *df, int *xy, int npar,
+                                   struct score_args *args);
+
+double bdeu_pair_score_diff(struct dataframe *df, int x, int y, int *n_xy,
+                                struct score_args *args);
+
+double discrete_bic_pair_score_diff(struct dataframe *df, int x, int y,
+                                        int *n_xy, struct score_args *args);
+
 double bic_score(struct dataframe *df, int *xy, int npar,
                      struct score_args *args);
 